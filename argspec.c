@@ -0,0 +1,212 @@
+/**
+ * @file argspec.c
+ * @brief Precompiled argument specs for native functions.
+ */
+#include <stdarg.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/vm.h>
+#include <kuroko/util.h>
+
+#include "argspec.h"
+#include "roots.h"
+
+#define SLOT_TYPED   (1 << 0)
+#define SLOT_PRESENT (1 << 1)
+
+/* Specs are compiled on first use, which may happen on several threads at once. */
+static pthread_mutex_t compileLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void compileSpec(struct DemoArgSpec * spec) {
+	int optional = 0;
+	int keywordOnly = 0;
+
+	for (const char * f = spec->format; *f && !spec->slow; ++f) {
+		switch (*f) {
+			case '|':
+				optional = 1;
+				break;
+			case '$':
+				keywordOnly = 1;
+				break;
+			case '*':
+				if (spec->star || keywordOnly) spec->slow = 1;
+				spec->star = 1;
+				keywordOnly = 1;
+				break;
+			case '!':
+			case '?': {
+				if (!spec->count) {
+					spec->slow = 1;
+					break;
+				}
+				spec->slots[spec->count-1].flags |= (*f == '!') ? SLOT_TYPED : SLOT_PRESENT;
+				break;
+			}
+			case 'V': case 'O': case 's': case 'z':
+			case 'i': case 'n': case 'N': case 'd': case 'p': {
+				if (spec->count == DEMO_ARGSPEC_MAX || !spec->names[spec->count]) {
+					spec->slow = 1;
+					break;
+				}
+				const char * name = spec->names[spec->count];
+				KrkString * interned = krk_copyString(name, strlen(name));
+				demo_keepAlive(OBJECT_VAL(interned));
+
+				spec->slots[spec->count].type = *f;
+				spec->slots[spec->count].name = interned;
+				spec->count++;
+				if (!optional) spec->required = spec->count;
+				if (!keywordOnly) spec->positional = spec->count;
+				break;
+			}
+			default:
+				/* Anything else is left to krk_parseArgs. */
+				spec->slow = 1;
+				break;
+		}
+	}
+
+	/* Publish the slots before any other thread can see the spec as ready. */
+	__atomic_store_n(&spec->ready, 1, __ATOMIC_RELEASE);
+}
+
+static int parseFast(struct DemoArgSpec * spec, int argc, const KrkValue argv[], int hasKw, va_list args) {
+	KrkValue values[DEMO_ARGSPEC_MAX];
+	unsigned int provided;
+	int given = argc < spec->positional ? argc : spec->positional;
+
+	if (argc > spec->positional && !spec->star) return 0;
+
+	for (int i = 0; i < given; ++i) values[i] = argv[i];
+	provided = (1u << given) - 1;
+
+	if (hasKw) {
+		/* Names were interned when the spec was compiled, so each probe is a
+		 * hash lookup with pointer comparison. If some keyword did not match,
+		 * or duplicates a positional argument, let krk_parseArgs complain. */
+		KrkTable * kwargs = AS_DICT(argv[argc]);
+		size_t found = 0;
+		for (int i = given; i < spec->count; ++i) {
+			if (krk_tableGet_fast(kwargs, spec->slots[i].name, &values[i])) {
+				provided |= 1u << i;
+				found++;
+			}
+		}
+		if (found != kwargs->count) return 0;
+	}
+
+	unsigned int required = (1u << spec->required) - 1;
+	if ((provided & required) != required) return 0;
+
+	for (int i = 0; i <= spec->count; ++i) {
+		/* '*' has no slot of its own; its outputs follow the last positional. */
+		if (spec->star && i == spec->positional) {
+			int * remainingCount = va_arg(args, int*);
+			const KrkValue ** remaining = va_arg(args, const KrkValue**);
+			*remainingCount = argc > given ? argc - given : 0;
+			*remaining = &argv[given];
+		}
+
+		if (i == spec->count) break;
+
+		struct DemoArgSlot * slot = &spec->slots[i];
+		KrkClass * type = (slot->flags & SLOT_TYPED) ? va_arg(args, KrkClass*) : NULL;
+		int * present = (slot->flags & SLOT_PRESENT) ? va_arg(args, int*) : NULL;
+		void * out = va_arg(args, void*);
+
+		if (!(provided & (1u << i))) {
+			if (present) *present = 0;
+			continue;
+		}
+		if (present) *present = 1;
+
+		KrkValue value = values[i];
+		switch (slot->type) {
+			case 'V':
+				*(KrkValue*)out = value;
+				break;
+			case 'O':
+				if (IS_NONE(value)) {
+					*(KrkObj**)out = NULL;
+				} else if (IS_OBJECT(value) && (!type || krk_isInstanceOf(value, type))) {
+					*(KrkObj**)out = AS_OBJECT(value);
+				} else {
+					return 0;
+				}
+				break;
+			case 'z':
+				if (IS_NONE(value)) {
+					*(const char**)out = NULL;
+					break;
+				}
+				/* fallthrough */
+			case 's':
+				if (!IS_STRING(value)) return 0;
+				*(const char**)out = AS_CSTRING(value);
+				break;
+			case 'i':
+				if (!IS_INTEGER(value) || AS_INTEGER(value) < INT_MIN || AS_INTEGER(value) > INT_MAX) return 0;
+				*(int*)out = AS_INTEGER(value);
+				break;
+			case 'n':
+				if (!IS_INTEGER(value)) return 0;
+				*(ssize_t*)out = AS_INTEGER(value);
+				break;
+			case 'N':
+				if (!IS_INTEGER(value) || AS_INTEGER(value) < 0) return 0;
+				*(size_t*)out = AS_INTEGER(value);
+				break;
+			case 'd':
+				if (IS_FLOATING(value)) {
+					*(double*)out = AS_FLOATING(value);
+				} else if (IS_INTEGER(value)) {
+					*(double*)out = (double)AS_INTEGER(value);
+				} else {
+					return 0;
+				}
+				break;
+			case 'p':
+				if (IS_BOOLEAN(value)) {
+					*(int*)out = AS_BOOLEAN(value);
+				} else if (IS_NONE(value)) {
+					*(int*)out = 0;
+				} else if (IS_INTEGER(value)) {
+					*(int*)out = AS_INTEGER(value) != 0;
+				} else {
+					return 0;
+				}
+				break;
+		}
+	}
+
+	return 1;
+}
+
+int demo_parseArgsSpec(const char * _method_name, int argc, const KrkValue argv[], int hasKw,
+		struct DemoArgSpec * spec, ...) {
+	if (!__atomic_load_n(&spec->ready, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_lock(&compileLock);
+		if (!spec->ready) compileSpec(spec);
+		pthread_mutex_unlock(&compileLock);
+	}
+
+	va_list args;
+	int result = 0;
+
+	if (!spec->slow) {
+		va_start(args, spec);
+		result = parseFast(spec, argc, argv, hasKw, args);
+		va_end(args);
+		if (result) return 1;
+	}
+
+	/* Conversions, errors, and unsupported formats take the normal path. */
+	va_start(args, spec);
+	result = krk_parseVArgs(_method_name, argc, argv, hasKw, spec->format, (const char**)spec->names, args);
+	va_end(args);
+	return result;
+}
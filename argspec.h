@@ -0,0 +1,75 @@
+/**
+ * @file argspec.h
+ * @brief Precompiled argument specs for native functions.
+ *
+ * @c krk_parseArgs interprets its format string and compares keyword
+ * names with @c strcmp on every call. For small native functions that
+ * are called very often, that can cost more than the function itself.
+ *
+ * A @c DemoArgSpec holds the same format string and names, but is
+ * compiled once, on first use: the format is split into per-argument
+ * slots and every name is interned, so keyword arguments are found by
+ * a single hash probe and pointer comparison. Compilation takes a lock,
+ * so a spec can be shared by functions called from several threads.
+ * Declare the spec as a @c static inside the function and call
+ * @c demo_parseArgs with the same output pointers you would pass to
+ * @c krk_parseArgs
+ *
+ * @code
+ * KRK_Function(example) {
+ *     static struct DemoArgSpec spec = DEMO_ARGSPEC("Vis", "a", "b", "c");
+ *     if (!demo_parseArgs(&spec, &a, &b, &c)) return NONE_VAL();
+ *     ...
+ * }
+ * @endcode
+ *
+ * The fast path understands the format codes @c V, @c O, @c s, @c z,
+ * @c i, @c n, @c N, @c d, and @c p with the modifiers @c !, @c ?, @c |,
+ * @c $, and @c *. Anything else, and any call that would need a type
+ * conversion or produce an error, is handed to @c krk_parseVArgs, so
+ * results and error messages are always the same as @c krk_parseArgs
+ */
+#pragma once
+
+#include <stdarg.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/value.h>
+#include <kuroko/object.h>
+
+#define DEMO_ARGSPEC_MAX 16
+
+struct DemoArgSlot {
+	char type;
+	unsigned char flags;
+	KrkString * name;
+};
+
+/**
+ * @brief Compiled argument spec. Build with @c DEMO_ARGSPEC
+ */
+struct DemoArgSpec {
+	const char * format;
+	const char * names[DEMO_ARGSPEC_MAX];
+	int ready;       /**< Set once the spec has been compiled. */
+	int slow;        /**< Format uses something only krk_parseArgs handles. */
+	int count;       /**< Number of argument slots. */
+	int required;    /**< Number of required positional arguments. */
+	int positional;  /**< Number of arguments that may be passed positionally. */
+	int star;        /**< Whether extra positionals are collected with '*' */
+	struct DemoArgSlot slots[DEMO_ARGSPEC_MAX];
+};
+
+/**
+ * @brief Static initializer for a @c DemoArgSpec
+ */
+#define DEMO_ARGSPEC(fmt, ...) { .format = fmt, .names = { __VA_ARGS__ } }
+
+extern int demo_parseArgsSpec(const char * _method_name, int argc, const KrkValue argv[], int hasKw,
+	struct DemoArgSpec * spec, ...);
+
+/**
+ * @brief Parse arguments with a precompiled spec.
+ *
+ * Use like @c krk_parseArgs from inside a @c KRK_Function or @c KRK_Method
+ */
+#define demo_parseArgs(spec, ...) demo_parseArgsSpec(_method_name, argc, argv, hasKw, spec, __VA_ARGS__)
@@ -0,0 +1,107 @@
+/**
+ * @file attrs.c
+ * @brief Pre-resolved attribute handles for the C API.
+ *
+ * The cached slot is only trusted when the module's table, the table's
+ * entry array, and the key at the cached index all still match. Tables
+ * that are resized get a new entry array, and deleted keys are replaced
+ * in their entry, so either change sends the lookup back to the table.
+ *
+ * Handles may be shared between threads. The name is interned under a
+ * lock, and the cached slot fields are loaded and stored individually;
+ * a mix of fields from two different updates can only pass the checks
+ * if it still names a slot that holds the key.
+ */
+#include <pthread.h>
+#include <string.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/vm.h>
+#include <kuroko/util.h>
+
+#include "attrs.h"
+#include "roots.h"
+
+static pthread_mutex_t resolveLock = PTHREAD_MUTEX_INITIALIZER;
+
+static KrkString * resolve(DemoAttr * attr) {
+	KrkString * key = __atomic_load_n(&attr->key, __ATOMIC_ACQUIRE);
+	if (key) return key;
+
+	pthread_mutex_lock(&resolveLock);
+	key = attr->key;
+	if (!key) {
+		key = krk_copyString(attr->name, strlen(attr->name));
+		demo_keepAlive(OBJECT_VAL(key));
+		__atomic_store_n(&attr->key, key, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&resolveLock);
+	return key;
+}
+
+static KrkTable * moduleTable(KrkValue owner) {
+	if (!IS_INSTANCE(owner) || AS_INSTANCE(owner)->_class != vm.baseClasses->moduleClass) return NULL;
+	return &AS_INSTANCE(owner)->fields;
+}
+
+static int keyAt(KrkTable * table, size_t index, KrkString * key) {
+	KrkValue entryKey = table->entries[index].key;
+	return IS_OBJECT(entryKey) && AS_OBJECT(entryKey) == (KrkObj*)key;
+}
+
+static KrkTableEntry * cachedEntry(KrkTable * table, DemoAttr * attr, KrkString * key) {
+	KrkTable * cachedTable = __atomic_load_n(&attr->table, __ATOMIC_RELAXED);
+	KrkTableEntry * cachedEntries = __atomic_load_n(&attr->entries, __ATOMIC_RELAXED);
+	size_t index = __atomic_load_n(&attr->index, __ATOMIC_RELAXED);
+
+	if (cachedTable == table && cachedEntries == table->entries &&
+		index < table->capacity && keyAt(table, index, key)) {
+		return &table->entries[index];
+	}
+	return NULL;
+}
+
+static KrkTableEntry * findEntry(KrkTable * table, DemoAttr * attr, KrkString * key) {
+	KrkValue unused;
+	if (!krk_tableGet_fast(table, key, &unused)) return NULL;
+
+	/* The key is present, so a walk from its home slot will reach it. */
+	size_t index = key->obj.hash & (table->capacity - 1);
+	while (!keyAt(table, index, key)) index = (index + 1) % table->capacity;
+
+	__atomic_store_n(&attr->table, table, __ATOMIC_RELAXED);
+	__atomic_store_n(&attr->entries, table->entries, __ATOMIC_RELAXED);
+	__atomic_store_n(&attr->index, index, __ATOMIC_RELAXED);
+	return &table->entries[index];
+}
+
+KrkValue demo_attrGet(KrkValue owner, DemoAttr * attr) {
+	KrkString * key = resolve(attr);
+	KrkTable * table = moduleTable(owner);
+
+	if (table) {
+		KrkTableEntry * entry = cachedEntry(table, attr, key);
+		if (!entry) entry = findEntry(table, attr, key);
+		if (entry) return entry->value;
+	}
+
+	return krk_valueGetAttribute(owner, key->chars);
+}
+
+KrkValue demo_attrSet(KrkValue owner, DemoAttr * attr, KrkValue to) {
+	KrkString * key = resolve(attr);
+	KrkTable * table = moduleTable(owner);
+
+	if (table) {
+		KrkTableEntry * entry = cachedEntry(table, attr, key);
+		if (entry) {
+			entry->value = to;
+		} else {
+			/* Remember where it went, so the next get or set is direct. */
+			krk_tableSet(table, OBJECT_VAL(key), to);
+			findEntry(table, attr, key);
+		}
+		return to;
+	}
+
+	return krk_valueSetAttribute(owner, key->chars, to);
+}
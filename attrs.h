@@ -0,0 +1,57 @@
+/**
+ * @file attrs.h
+ * @brief Pre-resolved attribute handles for the C API.
+ *
+ * @c krk_valueGetAttribute and @c krk_valueSetAttribute take a C string,
+ * which has to be hashed and looked up in the string table on every
+ * call. A @c DemoAttr resolves its name to an interned string once, on
+ * first use, and then remembers where it last found the attribute in a
+ * module's globals. While that slot is still valid, a get or set is a
+ * couple of pointer comparisons and a load or store.
+ *
+ * @code
+ * static DemoAttr attr_a = DEMO_ATTR("a");
+ * KrkValue a = demo_attrGet(OBJECT_VAL(main_module), &attr_a);
+ * @endcode
+ *
+ * Handles may be used with any value. Modules take the fast path; for
+ * everything else they fall back to the generic attribute functions, so
+ * descriptors, @c __getattr__ and @c __setattr__ behave as usual.
+ * A handle belongs to the VM it was first used with.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/value.h>
+#include <kuroko/object.h>
+
+/**
+ * @brief Attribute handle. Build with @c DEMO_ATTR
+ */
+typedef struct DemoAttr {
+	const char * name;
+	KrkString * key;        /**< Interned name, set on first use. */
+	KrkTable * table;       /**< Table the attribute was last found in. */
+	KrkTableEntry * entries;/**< That table's entry array at the time. */
+	size_t index;           /**< Entry the attribute was found at. */
+} DemoAttr;
+
+/**
+ * @brief Static initializer for a @c DemoAttr
+ */
+#define DEMO_ATTR(n) { .name = n }
+
+/**
+ * @brief Get an attribute through a handle.
+ *
+ * Behaves like @c krk_valueGetAttribute
+ */
+extern KrkValue demo_attrGet(KrkValue owner, DemoAttr * attr);
+
+/**
+ * @brief Set an attribute through a handle.
+ *
+ * Behaves like @c krk_valueSetAttribute
+ */
+extern KrkValue demo_attrSet(KrkValue owner, DemoAttr * attr, KrkValue to);
@@ -0,0 +1,94 @@
+/**
+ * @file batch.c
+ * @brief Call a Kuroko callable over a C array.
+ */
+#include <string.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/vm.h>
+#include <kuroko/util.h>
+
+#include "batch.h"
+
+static KrkValue boxInput(enum DemoBatchType inType, const void * inputs, size_t i) {
+	switch (inType) {
+		case DEMO_BATCH_INT:    return INTEGER_VAL(((const krk_integer_type*)inputs)[i]);
+		case DEMO_BATCH_DOUBLE: return FLOATING_VAL(((const double*)inputs)[i]);
+		case DEMO_BATCH_STRING: {
+			const char * str = ((const char * const *)inputs)[i];
+			return OBJECT_VAL(krk_copyString(str, strlen(str)));
+		}
+		case DEMO_BATCH_VALUE:  return ((const KrkValue*)inputs)[i];
+		default:                return NONE_VAL();
+	}
+}
+
+static int storeOutput(enum DemoBatchType outType, void * outputs, size_t i, KrkValue result) {
+	switch (outType) {
+		case DEMO_BATCH_NONE:
+			return 1;
+		case DEMO_BATCH_INT:
+			if (IS_INTEGER(result)) {
+				((krk_integer_type*)outputs)[i] = AS_INTEGER(result);
+			} else if (IS_FLOATING(result)) {
+				((krk_integer_type*)outputs)[i] = (krk_integer_type)AS_FLOATING(result);
+			} else {
+				break;
+			}
+			return 1;
+		case DEMO_BATCH_DOUBLE:
+			if (IS_FLOATING(result)) {
+				((double*)outputs)[i] = AS_FLOATING(result);
+			} else if (IS_INTEGER(result)) {
+				((double*)outputs)[i] = (double)AS_INTEGER(result);
+			} else {
+				break;
+			}
+			return 1;
+		default:
+			break;
+	}
+	krk_runtimeError(vm.exceptions->typeError, "batch result should be %s, not '%T'",
+		outType == DEMO_BATCH_INT ? "int" : "float", result);
+	return 0;
+}
+
+size_t demo_callBatch(KrkValue callable,
+		enum DemoBatchType inType, const void * inputs, size_t count,
+		enum DemoBatchType outType, void * outputs) {
+
+	if (inType == DEMO_BATCH_NONE || outType == DEMO_BATCH_STRING || outType == DEMO_BATCH_VALUE) {
+		krk_runtimeError(vm.exceptions->valueError, "unsupported batch element type");
+		return 0;
+	}
+
+	/* Keep the callable rooted for the whole batch. */
+	krk_push(callable);
+
+	NativeFn native = NULL;
+	if (IS_NATIVE(callable)) native = AS_NATIVE(callable)->function;
+
+	size_t i;
+	for (i = 0; i < count; ++i) {
+		KrkValue arg = boxInput(inType, inputs, i);
+		KrkValue result;
+
+		if (native) {
+			/* Pass a copy of the argument, as the stack may move while the
+			 * native runs; the pushed original keeps it reachable. */
+			KrkValue argv[1] = {arg};
+			krk_push(arg);
+			result = native(1, argv, 0);
+			krk_pop();
+		} else {
+			krk_push(callable);
+			krk_push(arg);
+			result = krk_callStack(1);
+		}
+
+		if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) break;
+		if (!storeOutput(outType, outputs, i, result)) break;
+	}
+
+	krk_pop();
+	return i;
+}
@@ -0,0 +1,47 @@
+/**
+ * @file batch.h
+ * @brief Call a Kuroko callable over a C array.
+ *
+ * Hosts that apply a Kuroko function to every record of a large array
+ * would otherwise box each input, push it, call, check for exceptions,
+ * and unbox the result one by one in their own loop. @c demo_callBatch
+ * does all of that in a single call, with the input and output types
+ * resolved once for the whole batch. Native callables are invoked
+ * directly, skipping the VM's call dispatch entirely.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/value.h>
+
+/**
+ * @brief Element types for batch inputs and outputs.
+ */
+enum DemoBatchType {
+	DEMO_BATCH_NONE,    /**< Outputs only: discard the results. */
+	DEMO_BATCH_INT,     /**< @c krk_integer_type */
+	DEMO_BATCH_DOUBLE,  /**< @c double */
+	DEMO_BATCH_STRING,  /**< Inputs only: @c const char* */
+	DEMO_BATCH_VALUE,   /**< Inputs only: @c KrkValue */
+};
+
+/**
+ * @brief Call @p callable once for each of @p count inputs.
+ *
+ * Each element of @p inputs, interpreted as @p inType, is passed to
+ * @p callable as its only argument. Results are converted to
+ * @p outType and stored in @p outputs at the same index; ints and floats
+ * are converted to each other as needed, and any other result raises
+ * @c TypeError. Object results can not be stored in a C array safely,
+ * as the garbage collector can not see them there, so @c DEMO_BATCH_VALUE
+ * is not accepted for outputs.
+ *
+ * Processing stops at the first exception, which is left set.
+ *
+ * @return The number of elements processed successfully; anything less
+ *         than @p count means an exception was raised.
+ */
+extern size_t demo_callBatch(KrkValue callable,
+	enum DemoBatchType inType, const void * inputs, size_t count,
+	enum DemoBatchType outType, void * outputs);
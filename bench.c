@@ -0,0 +1,359 @@
+/**
+ * @brief Native binding call overhead benchmark.
+ *
+ * Measures the cost of crossing between C and Kuroko: calling native
+ * functions from Kuroko code, and calling into the VM from C. Each case
+ * runs a few warmup rounds and then several timed rounds; the report
+ * gives nanoseconds per call for the fastest, median, 90th percentile
+ * and slowest round.
+ *
+ * The natives are silent copies of the ones in @c demo.c - they take
+ * the same arguments and parse them the same way, but report nothing,
+ * so the figures cover argument parsing and the call itself. Next to
+ * each of them is a case for the faster path the helpers offer, so a
+ * helper that stops paying for itself shows up here:
+ *
+ * - @c krk_parseArgs against a precompiled @c DemoArgSpec
+ * - @c krk_pushStringBuilderFormat against a @c DemoFormatPlan
+ * - @c krk_valueGetAttribute and @c krk_valueSetAttribute against
+ *   @c DemoAttr handles
+ * - a hand-written @c krk_callStack loop over a C array against
+ *   @c demo_callBatch, and against the same loop written in Kuroko over
+ *   @c HostBuffer views of the arrays
+ *
+ * Calls made from Kuroko are timed inside a managed loop, and the cost
+ * of an empty loop is subtracted. Calls made from C are timed in a C
+ * loop, with nothing subtracted.
+ *
+ * Usage: ./bench [iterations per round]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/vm.h>
+#include <kuroko/util.h>
+
+#include "argspec.h"
+#include "attrs.h"
+#include "batch.h"
+#include "fmtplan.h"
+#include "hostbuf.h"
+
+#define WARMUP_ROUNDS 3
+#define TIMED_ROUNDS 15
+
+KRK_Function(do_something) {
+	return NONE_VAL();
+}
+
+KRK_Function(do_something_with_args) {
+	KrkValue a;
+	int b;
+	char * c;
+	if (!krk_parseArgs("Vis", (const char*[]){"a","b","c"}, &a, &b, &c)) return NONE_VAL();
+	return NONE_VAL();
+}
+
+KRK_Function(spec_args) {
+	KrkValue a;
+	int b;
+	char * c;
+	static struct DemoArgSpec spec = DEMO_ARGSPEC("Vis", "a", "b", "c");
+	if (!demo_parseArgs(&spec, &a, &b, &c)) return NONE_VAL();
+	return NONE_VAL();
+}
+
+KRK_Function(more_args) {
+	KrkDict * a;
+	char * b = "oh no";
+	double c = 3.14159;
+	static struct DemoArgSpec spec = DEMO_ARGSPEC("O!|z$d", "a", "b", "c");
+	if (!demo_parseArgs(&spec, KRK_BASE_CLASS(dict), &a, &b, &c)) return NONE_VAL();
+	return NONE_VAL();
+}
+
+KRK_Function(yet_more_args) {
+	KrkValue a;
+	int b;
+	int c_present;
+	size_t c;
+	int remaining_count;
+	const KrkValue *remaining;
+	if (!krk_parseArgs("Vi|N?*", (const char*[]){"a","b","c"},
+		&a, &b, &c_present, &c, &remaining_count, &remaining)) return NONE_VAL();
+
+	struct StringBuilder sb = {0};
+	static struct DemoFormatPlan c_plan = DEMO_FORMAT("c was %zu, ");
+	if (!krk_pushStringBuilderFormat(&sb, "Received a %T that looks like %R, ", a, a)) return NONE_VAL();
+	if (!krk_pushStringBuilderFormat(&sb, "the value %d, ", b)) return NONE_VAL();
+	if (c_present) {
+		if (!demo_pushFormat(&sb, &c_plan, c)) return NONE_VAL();
+	} else {
+		if (!krk_pushStringBuilderFormat(&sb, "c was not provided, ")) return NONE_VAL();
+	}
+	if (!krk_pushStringBuilderFormat(&sb, "and there were %d additional arguments.\n", remaining_count)) return NONE_VAL();
+	krk_discardStringBuilder(&sb);
+	return NONE_VAL();
+}
+
+/* The same line built both ways; neither keeps the result. */
+KRK_Function(format_args) {
+	struct StringBuilder sb = {0};
+	if (!krk_pushStringBuilderFormat(&sb, "Received a %T that looks like %R, the value %d.\n",
+		argv[0], argv[0], (int)AS_INTEGER(argv[1]))) return NONE_VAL();
+	krk_discardStringBuilder(&sb);
+	return NONE_VAL();
+}
+
+KRK_Function(format_plan) {
+	struct StringBuilder sb = {0};
+	static struct DemoFormatPlan plan = DEMO_FORMAT("Received a %T that looks like %R, the value %d.\n");
+	if (!demo_pushFormat(&sb, &plan, argv[0], argv[0], (int)AS_INTEGER(argv[1]))) return NONE_VAL();
+	krk_discardStringBuilder(&sb);
+	return NONE_VAL();
+}
+
+struct BenchCase {
+	const char * name;
+	const char * body;
+};
+
+static const struct BenchCase cases[] = {
+	{"do_something",           "utils.do_something()"},
+	{"do_something_with_args", "utils.do_something_with_args(a,b,'test')"},
+	{"  with DemoArgSpec",     "utils.spec_args(a,b,'test')"},
+	{"  by keyword",           "utils.do_something_with_args(a,b=b,c='test')"},
+	{"  by keyword, spec",     "utils.spec_args(a,b=b,c='test')"},
+	{"more_args",              "utils.more_args(d,c=0.12345)"},
+	{"yet_more_args",          "utils.yet_more_args(l,1234,5,6,7)"},
+	{"format_args",            "utils.format_args(l,b)"},
+	{"  with DemoFormatPlan",  "utils.format_plan(l,b)"},
+};
+
+/* Cases timed from C; each runs its operation @p n times. */
+struct BenchCall {
+	const char * name;
+	void (*run)(size_t n);
+};
+
+static KrkInstance * main_module;
+static KrkValue score;
+static double * records;
+static double * scores;
+static KrkValue bufferLoop, recordsView, scoresView;
+
+static void callScore(size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		krk_push(score);
+		krk_push(INTEGER_VAL(i));
+		krk_callStack(1);
+		if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return;
+	}
+}
+
+static void scoreByHand(size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		krk_push(score);
+		krk_push(FLOATING_VAL(records[i]));
+		KrkValue result = krk_callStack(1);
+		if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return;
+		scores[i] = IS_FLOATING(result) ? AS_FLOATING(result) : (double)AS_INTEGER(result);
+	}
+}
+
+static void scoreBatch(size_t n) {
+	demo_callBatch(score, DEMO_BATCH_DOUBLE, records, n, DEMO_BATCH_DOUBLE, scores);
+}
+
+/* The same batch looped inside the VM, over views of the C arrays. */
+static void scoreInVM(size_t n) {
+	krk_push(bufferLoop);
+	krk_push(score);
+	krk_push(recordsView);
+	krk_push(scoresView);
+	krk_callStack(3);
+}
+
+static void getByName(size_t n) {
+	for (size_t i = 0; i < n; ++i) krk_valueGetAttribute(OBJECT_VAL(main_module), "a");
+}
+
+static void getByHandle(size_t n) {
+	static DemoAttr attr_a = DEMO_ATTR("a");
+	for (size_t i = 0; i < n; ++i) demo_attrGet(OBJECT_VAL(main_module), &attr_a);
+}
+
+static void setByName(size_t n) {
+	for (size_t i = 0; i < n; ++i) krk_valueSetAttribute(OBJECT_VAL(main_module), "b", INTEGER_VAL(i));
+}
+
+static void setByHandle(size_t n) {
+	static DemoAttr attr_b = DEMO_ATTR("b");
+	for (size_t i = 0; i < n; ++i) demo_attrSet(OBJECT_VAL(main_module), &attr_b, INTEGER_VAL(i));
+}
+
+static const struct BenchCall calls[] = {
+	{"C -> def score(x)",      callScore},
+	{"C array, by hand",       scoreByHand},
+	{"  with demo_callBatch",  scoreBatch},
+	{"  looped in the VM",     scoreInVM},
+	{"C getattr by name",      getByName},
+	{"  with DemoAttr",        getByHandle},
+	{"C setattr by name",      setByName},
+	{"  with DemoAttr",        setByHandle},
+};
+
+static void checkException(const char * name) {
+	if (!(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) return;
+	fprintf(stderr, "bench: '%s' raised an exception\n", name);
+	krk_dumpTraceback();
+	exit(1);
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compareDoubles(const void * a, const void * b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+static void report(const char * name, double * samples) {
+	qsort(samples, TIMED_ROUNDS, sizeof(double), compareDoubles);
+	printf("%-24s %9.1f %9.1f %9.1f %9.1f\n", name,
+		samples[0],
+		samples[TIMED_ROUNDS / 2],
+		samples[(TIMED_ROUNDS * 9) / 10],
+		samples[TIMED_ROUNDS - 1]);
+	fflush(stdout);
+}
+
+static KrkValue getGlobal(KrkInstance * module, const char * name) {
+	KrkValue out = NONE_VAL();
+	krk_tableGet_fast(&module->fields, krk_copyString(name, strlen(name)), &out);
+	return out;
+}
+
+/* Run the Kuroko function @p loop with @p n, returning nanoseconds per iteration. */
+static double timeLoop(const char * name, KrkValue loop, size_t n) {
+	double start = now();
+	krk_push(loop);
+	krk_push(INTEGER_VAL(n));
+	krk_callStack(1);
+	double end = now();
+	checkException(name);
+	return (end - start) / n;
+}
+
+/* Run a C case @p n times, returning nanoseconds per operation. */
+static double timeCall(const struct BenchCall * call, size_t n) {
+	double start = now();
+	call->run(n);
+	double end = now();
+	checkException(call->name);
+	return (end - start) / n;
+}
+
+static KrkValue defineLoop(KrkInstance * module, const char * body) {
+	char src[256];
+	snprintf(src, sizeof(src),
+		"def _bench_loop(n):\n"
+		"  for i in range(n):\n"
+		"    %s\n", body);
+	krk_interpret(src, "<bench>");
+	checkException(body);
+	return getGlobal(module, "_bench_loop");
+}
+
+int main(int argc, char *argv[]) {
+	size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+	if (!n) n = 1;
+
+	krk_initVM(0);
+	main_module = krk_startModule("__main__");
+
+	KrkInstance * utils = krk_startModule("utils");
+	BIND_FUNC(utils,do_something);
+	BIND_FUNC(utils,do_something_with_args);
+	BIND_FUNC(utils,spec_args);
+	BIND_FUNC(utils,more_args);
+	BIND_FUNC(utils,yet_more_args);
+	BIND_FUNC(utils,format_args);
+	BIND_FUNC(utils,format_plan);
+	krk_currentThread.module = main_module;
+	demo_bufferInit(main_module);
+
+	krk_interpret(
+		"import utils\n"
+		"let a = 42\n"
+		"let b = 69\n"
+		"let d = {'a': 7}\n"
+		"let l = [1,2,3]\n"
+		"def score(x):\n"
+		"  return x + 1\n"
+		"def _bench_buffers(f, src, dst):\n"
+		"  let i = 0\n"
+		"  let n = len(src)\n"
+		"  while i < n:\n"
+		"    dst[i] = f(src[i])\n"
+		"    i += 1\n",
+		"<bench>");
+	checkException("setup");
+
+	printf("%zu calls per round, %d warmup and %d timed rounds, ns/call\n",
+		n, WARMUP_ROUNDS, TIMED_ROUNDS);
+	printf("%-24s %9s %9s %9s %9s\n", "case", "min", "p50", "p90", "max");
+
+	double samples[TIMED_ROUNDS];
+	double baseline[TIMED_ROUNDS];
+
+	KrkValue emptyLoop = defineLoop(main_module, "pass");
+	krk_push(emptyLoop);
+	for (int r = 0; r < WARMUP_ROUNDS; ++r) timeLoop("pass", emptyLoop, n);
+	for (int r = 0; r < TIMED_ROUNDS; ++r) baseline[r] = timeLoop("pass", emptyLoop, n);
+	krk_pop();
+	qsort(baseline, TIMED_ROUNDS, sizeof(double), compareDoubles);
+	double loopCost = baseline[TIMED_ROUNDS / 2];
+
+	for (size_t c = 0; c < sizeof(cases) / sizeof(*cases); ++c) {
+		KrkValue loop = defineLoop(main_module, cases[c].body);
+		krk_push(loop);
+		for (int r = 0; r < WARMUP_ROUNDS; ++r) timeLoop(cases[c].name, loop, n);
+		for (int r = 0; r < TIMED_ROUNDS; ++r) samples[r] = timeLoop(cases[c].name, loop, n) - loopCost;
+		krk_pop();
+		report(cases[c].name, samples);
+	}
+
+	score = getGlobal(main_module, "score");
+	records = malloc(n * sizeof(double));
+	scores = malloc(n * sizeof(double));
+	if (!records || !scores) {
+		fprintf(stderr, "bench: out of memory\n");
+		return 1;
+	}
+	for (size_t i = 0; i < n; ++i) records[i] = (double)i;
+	bufferLoop = getGlobal(main_module, "_bench_buffers");
+	recordsView = demo_newBuffer(records, n, 'd', 1, NULL, NULL);
+	krk_push(recordsView);
+	scoresView = demo_newBuffer(scores, n, 'd', 0, NULL, NULL);
+	krk_push(scoresView);
+
+	for (size_t c = 0; c < sizeof(calls) / sizeof(*calls); ++c) {
+		for (int r = 0; r < WARMUP_ROUNDS; ++r) timeCall(&calls[c], n);
+		for (int r = 0; r < TIMED_ROUNDS; ++r) samples[r] = timeCall(&calls[c], n);
+		report(calls[c].name, samples);
+	}
+	krk_pop();
+	krk_pop();
+	printf("(empty loop iteration: %.1f ns, subtracted from calls made from Kuroko)\n", loopCost);
+
+	krk_freeVM();
+	free(records);
+	free(scores);
+	return 0;
+}
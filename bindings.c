@@ -0,0 +1,26 @@
+/**
+ * @file bindings.c
+ * @brief Plain C functions exposed to Kuroko through generated wrappers.
+ *
+ * Nothing in here knows about Kuroko; see @c bindings.h
+ */
+#include <math.h>
+#include <string.h>
+
+#include "bindings.h"
+
+int add_ints(int a, int b) {
+	return a + b;
+}
+
+double hypotenuse(double a, double b) {
+	return sqrt(a * a + b * b);
+}
+
+size_t count_vowels(const char * s) {
+	size_t count = 0;
+	for (; *s; ++s) {
+		if (strchr("aeiouAEIOU", *s)) count++;
+	}
+	return count;
+}
@@ -0,0 +1,34 @@
+/**
+ * @file bindings.h
+ * @brief Plain C functions exposed to Kuroko through generated wrappers.
+ *
+ * Prototypes marked with @c DEMO_BIND are read by @c genbind.py, which
+ * writes a @c KRK_Function wrapper for each of them to @c bindings_gen.c
+ * and a @c demo_bindGenerated function that binds them all to a module,
+ * just like @c BIND_FUNC would. The wrappers unbox positional arguments
+ * directly, with no format string to interpret; calls that use keyword
+ * arguments go through @c krk_parseArgs with the parameter names.
+ *
+ * Supported parameter types are @c int, @c double, @c size_t,
+ * @c const char*, and @c KrkValue. Return types may be any of those,
+ * or @c void. Each prototype must fit on one line.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/value.h>
+#include <kuroko/object.h>
+
+#define DEMO_BIND
+
+DEMO_BIND int add_ints(int a, int b);
+DEMO_BIND double hypotenuse(double a, double b);
+DEMO_BIND size_t count_vowels(const char * s);
+
+/**
+ * @brief Bind every @c DEMO_BIND function to @p module
+ *
+ * Defined in the generated @c bindings_gen.c
+ */
+extern void demo_bindGenerated(KrkInstance * module);
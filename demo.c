@@ -6,10 +6,26 @@
  * load Kuroko files, etc.
  */
 #include <stdio.h>
+#include <string.h>
 #include <kuroko/kuroko.h>
 #include <kuroko/vm.h>
 #include <kuroko/util.h>
 
+#include "argspec.h"
+#include "attrs.h"
+#include "batch.h"
+#include "bindings.h"
+#include "eventloop.h"
+#include "fmtplan.h"
+#include "gcscope.h"
+#include "gcstats.h"
+#include "guard.h"
+#include "hostbuf.h"
+#include "names.h"
+#include "profiler.h"
+#include "sink.h"
+#include "snippets.h"
+
 /**
  * The headers above expose a "vm" macro that expands to "krk_vm".
  *
@@ -81,6 +97,16 @@ KRK_Function(do_something_with_args) {
 		return NONE_VAL();
 	}
 
+	/*
+	 * @c krk_parseArgs reads its format string and compares argument names
+	 * every time it is called. For functions that are called very often,
+	 * @c argspec.h offers a precompiled alternative: declare the same
+	 * format and names once as a static @c DemoArgSpec and call
+	 * @c demo_parseArgs with the same outputs. The spec is compiled on
+	 * first use, and later calls only have to unbox the values.
+	 * See @c more_args below for how that looks.
+	 */
+
 	fprintf(stderr, "The type of 'a' is %s. The value of 'b' is %d. 'c' was '%s'.\n",
 		krk_typeName(a), b, c);
 
@@ -119,8 +145,14 @@ KRK_Function(more_args) {
 	char * b = "oh no";
 	double c = 3.14159;
 
-	if (!krk_parseArgs(
-		"O!|z$d", (const char*[]){"a","b","c"},
+	/*
+	 * This function uses a precompiled spec from @c argspec.h - it takes
+	 * the same format string and names as @c krk_parseArgs and fills in the
+	 * same outputs, but only interprets the format once.
+	 */
+	static struct DemoArgSpec spec = DEMO_ARGSPEC("O!|z$d", "a", "b", "c");
+
+	if (!demo_parseArgs(&spec,
 		KRK_BASE_CLASS(dict), &a, /* Pass type first when using ! */
 		&b, &c)) {
 		return NONE_VAL();
@@ -180,8 +212,16 @@ KRK_Function(yet_more_args) {
 		return NONE_VAL();
 	}
 
+	/*
+	 * Each call to @c krk_pushStringBuilderFormat scans its format string
+	 * again. When the same format is used very often, @c fmtplan.h can
+	 * compile it once into a plan of literal runs and conversions; the
+	 * plan also reserves space up front so the builder grows at most once.
+	 */
+	static struct DemoFormatPlan c_plan = DEMO_FORMAT("c was %zu, ");
+
 	if (c_present) {
-		if (!krk_pushStringBuilderFormat(&sb, "c was %zu, ", c)) return NONE_VAL();
+		if (!demo_pushFormat(&sb, &c_plan, c)) return NONE_VAL();
 	} else {
 		if (!krk_pushStringBuilderFormat(&sb, "c was not provided, ")) return NONE_VAL();
 	}
@@ -193,7 +233,7 @@ KRK_Function(yet_more_args) {
 	}
 
 	/* We probably want to print that. */
-	fwrite(sb.bytes, sb.capacity, 1, stderr);
+	fwrite(sb.bytes, sb.length, 1, stderr);
 	fflush(stderr);
 
 	/* Now discard the space allocated for the string builder. */
@@ -202,6 +242,55 @@ KRK_Function(yet_more_args) {
 	return NONE_VAL();
 }
 
+KRK_Function(buffer_sum) {
+	/*
+	 * Large arrays can be handed to Kuroko without copying them by
+	 * wrapping them in a @c HostBuffer from @c hostbuf.h - we'll make one
+	 * in @c main. Native functions can accept buffers with 'O!' and the
+	 * buffer class, and then work on the host's memory directly.
+	 */
+	struct DemoBuffer * buf;
+
+	if (!krk_parseArgs(
+		"O!", (const char*[]){"buf"},
+		demo_bufferClass, &buf)) {
+		return NONE_VAL();
+	}
+
+	if (!buf || buf->format != 'd') {
+		return krk_runtimeError(vm.exceptions->typeError, "expected a buffer of doubles");
+	}
+
+	double total = 0.0;
+	for (size_t i = 0; i < buf->count; ++i) {
+		total += ((double*)buf->data)[i];
+	}
+
+	return FLOATING_VAL(total);
+}
+
+/*
+ * The demo doubles as a smoke test for the helpers it shows off: after
+ * each section, it checks that the helper did what it claims, and
+ * @c main returns non-zero if any check failed. @c make @c check runs it.
+ */
+static int failures = 0;
+
+#define DEMO_CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} } while (0)
+
+/* Checks written in Kuroko fail by raising; the traceback has been printed. */
+static void checkScript(const char * src) {
+	krk_interpret(src, "<check>");
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
+		krk_currentThread.flags &= ~KRK_THREAD_HAS_EXCEPTION;
+		krk_currentThread.currentException = NONE_VAL();
+		failures++;
+	}
+}
 
 int main(int argc, char *argv[]) {
 
@@ -255,6 +344,18 @@ int main(int argc, char *argv[]) {
 	 */
 	krk_initVM(0);
 
+	/*
+	 * Some of the helpers used later in this demo need a few names interned
+	 * up front; see @c names.h
+	 */
+	demo_initNames();
+
+	/*
+	 * Collection counts from @c gcstats.h only include collections that
+	 * happen after @c demo_gcStatsInit, so we start counting right away.
+	 */
+	demo_gcStatsInit();
+
 	/*
 	 * Let's get right into things by executing some Kuroko code.
 	 *
@@ -335,6 +436,15 @@ int main(int argc, char *argv[]) {
 		fprintf(stderr, "If tableGet_fast returns 0, the key we were looking for was not found.\n");
 	}
 
+	/*
+	 * @c S() looks up or creates its string every time it runs. For names
+	 * used on hot paths, list them in @c names.h and they will be interned
+	 * once by @c demo_initNames - @c DEMO_NAME then costs only an array load.
+	 */
+	if (krk_tableGet_fast(&main_module->fields, DEMO_NAME(a), &member_from_fields)) {
+		fprintf(stderr, "a = %lld.\n", (long long)AS_INTEGER(member_from_fields));
+	}
+
 	/*
 	 * Values can also be set in a similar manner. Let's use
 	 * @c krk_valueSetAttribute to add a new global to our module.
@@ -346,6 +456,17 @@ int main(int argc, char *argv[]) {
 	 */
 	krk_interpret("print('b =', b)", "<stdin>");
 
+	/*
+	 * Both attribute functions take a C string, which has to be looked up
+	 * in the VM's string table every time. If you read or write the same
+	 * names over and over, @c attrs.h provides handles that resolve their
+	 * name once and remember where they found it in a module's globals.
+	 */
+	static DemoAttr attr_b = DEMO_ATTR("b");
+	demo_attrSet(OBJECT_VAL(main_module), &attr_b,
+		INTEGER_VAL(AS_INTEGER(demo_attrGet(OBJECT_VAL(main_module), &attr_b)) + 1));
+	fprintf(stderr, "b = %lld.\n", (long long)AS_INTEGER(demo_attrGet(OBJECT_VAL(main_module), &attr_b)));
+
 	/*
 	 * Let's build another module and demonstrate how to bind some C functions.
 	 */
@@ -372,6 +493,26 @@ int main(int argc, char *argv[]) {
 	BIND_FUNC(utils,more_args);
 	BIND_FUNC(utils,yet_more_args);
 
+	/*
+	 * Writing a @c KRK_Function by hand for every C function gets tedious.
+	 * The functions declared in @c bindings.h are ordinary C; the build
+	 * runs @c genbind.py over that header to generate wrappers that unbox
+	 * their arguments directly, and @c demo_bindGenerated binds them all.
+	 */
+	demo_bindGenerated(utils);
+
+	/*
+	 * Let's also share some host memory with Kuroko. The @c HostBuffer
+	 * class needs to be created once; after that, @c demo_newBuffer wraps
+	 * a C array without copying it. Slicing the buffer in Kuroko produces
+	 * views of the same memory.
+	 */
+	static double samples[] = {0.5, 1.5, 2.5, 3.5, 4.5};
+	demo_bufferInit(utils);
+	krk_attachNamedValue(&utils->fields, "samples",
+		demo_newBuffer(samples, sizeof(samples) / sizeof(*samples), 'd', 0, NULL, NULL));
+	BIND_FUNC(utils,buffer_sum);
+
 	/*
 	 * Now that we've built our new module, we should return to our original
 	 * module and import it. We do that by assign to the @c module member
@@ -393,9 +534,319 @@ int main(int argc, char *argv[]) {
 		"utils.more_args({'a': 7},c=0.12345)\n"
 		"utils.yet_more_args([1,2,3],1234)\n"
 		"utils.yet_more_args({1,2,3},420,69,'a','b','c')\n"
+		"print(utils.add_ints(2,3), utils.hypotenuse(3,4), utils.count_vowels('kuroko'))\n"
+		"let view = utils.samples[1:4]\n"
+		"view[0] = 10.0\n"
+		"print(utils.samples, len(view), view[0], utils.buffer_sum(view))\n"
 
 		,"<stdin>");
 
+	/*
+	 * Functions using a precompiled spec should reject bad arguments just
+	 * like @c krk_parseArgs would.
+	 */
+	checkScript(
+		"def raises(f, *args, **kwargs):\n"
+		"  try:\n"
+		"    f(*args, **kwargs)\n"
+		"  except Exception as e:\n"
+		"    return type(e)\n"
+		"  return None\n"
+		"assert raises(utils.more_args) is not None\n"
+		"assert raises(utils.more_args, [1]) is TypeError\n"
+		"assert raises(utils.more_args, {}, 'x', 1.0) is not None\n"
+		"assert raises(utils.more_args, {}, c='x') is not None\n"
+		"assert raises(utils.more_args, {}, d=1.0) is not None\n"
+		"assert raises(utils.more_args, {}, 'x', c=1.0) is None\n");
+
+	/* Buffers and their views stay inside the host's memory. */
+	checkScript(
+		"let buf = utils.samples\n"
+		"assert len(buf) == 5 and buf[-1] == 4.5\n"
+		"assert raises(lambda: buf[5]) is IndexError\n"
+		"assert raises(lambda: buf[-6]) is IndexError\n"
+		"let tail = buf[3:100]\n"
+		"assert len(tail) == 2 and tail[1] == 4.5\n"
+		"assert raises(lambda: tail[2]) is IndexError\n"
+		"assert raises(lambda: buf[::2]) is ValueError\n"
+		"assert utils.buffer_sum(buf[1:4]) == 16.0\n");
+
+	/*
+	 * Every call to @c krk_interpret scans and compiles its source text
+	 * before running it. If your host runs the same small snippets over
+	 * and over, the snippet cache from @c snippets.h can keep the compiled
+	 * code around. Once enabled, @c demo_interpretCached works just like
+	 * @c krk_interpret but only compiles a given source, file name, and
+	 * module combination once.
+	 */
+	demo_snippetCacheEnable(0);
+	for (int i = 0; i < 1000; ++i) {
+		demo_interpretCached("b = b + 1", "<stdin>");
+	}
+	demo_interpretCached("print('b =', b)", "<stdin>");
+
+	struct DemoSnippetStats stats = demo_snippetCacheStats();
+	fprintf(stderr, "Snippet cache: %zu hits, %zu misses, %zu entries.\n",
+		stats.hits, stats.misses, stats.entries);
+	DEMO_CHECK(stats.misses == 2 && stats.hits == 999 && stats.entries == 2);
+
+	/* The same source in another module is compiled again, and its entry
+	 * goes away when that module is collected. */
+	KrkInstance * scratch = krk_newInstance(vm.baseClasses->moduleClass);
+	krk_push(OBJECT_VAL(scratch));
+	krk_attachNamedObject(&scratch->fields, "__name__", (KrkObj*)S("scratch"));
+	krk_attachNamedValue(&scratch->fields, "b", INTEGER_VAL(0));
+	krk_currentThread.module = scratch;
+	demo_interpretCached("b = b + 1", "<stdin>");
+	krk_currentThread.module = main_module;
+	krk_pop();
+	DEMO_CHECK(demo_snippetCacheStats().misses == 3);
+	demo_collect();
+	DEMO_CHECK(demo_snippetCacheStats().entries == 2);
+
+	/*
+	 * Calling a Kuroko function from C for every element of a large array
+	 * means boxing, calling, checking, and unboxing each one in a loop.
+	 * @c demo_callBatch from @c batch.h runs that loop for you over plain
+	 * C arrays, writing each result back at the same index.
+	 */
+	krk_interpret(
+		"def score(x):\n"
+		"  return x * 2.5 + 1\n",
+		"<stdin>");
+	double records[] = {1.0, 2.0, 3.0, 4.0};
+	double scores[4];
+	KrkValue score = krk_valueGetAttribute(OBJECT_VAL(main_module), "score");
+	size_t scored = demo_callBatch(score,
+		DEMO_BATCH_DOUBLE, records, 4,
+		DEMO_BATCH_DOUBLE, scores);
+	for (size_t i = 0; i < scored; ++i) {
+		fprintf(stderr, "score(%f) = %f\n", records[i], scores[i]);
+	}
+
+	/*
+	 * Hosts that run many short requests can wrap each one in a scope
+	 * from @c gcscope.h - if the heap grew too much while the scope was
+	 * open, closing it collects the request's garbage right away, between
+	 * requests, instead of leaving it for a collection during a later one.
+	 * "Too much" is a share of the room left before the VM would collect
+	 * anyway; our requests are small, so we use a low share here.
+	 */
+	size_t scope_freed = 0;
+	for (int i = 0; i < 10; ++i) {
+		struct DemoGcScope scope;
+		demo_gcScopeOpen(&scope, 10);
+		demo_interpretCached("[str(x) for x in range(1000)]", "<request>");
+		scope_freed += demo_gcScopeClose(&scope);
+	}
+	fprintf(stderr, "Scopes freed %zu bytes between requests.\n", scope_freed);
+
+	/*
+	 * @c gcstats.h counts every collection, and times the ones run after
+	 * scopes. It also reports the heap size and live objects by type. Scripts can
+	 * see the same figures once @c gcstats() is bound into a module.
+	 */
+	struct DemoGcStats gc;
+	demo_gcStats(&gc);
+	fprintf(stderr, "Heap is %zu bytes after %zu collections (longest pause %.3fms).\n",
+		gc.heapSize, gc.collections, gc.pauseMax * 1000.0);
+
+	demo_gcStatsBind(vm.system);
+	krk_interpret(
+		"import kuroko\n"
+		"print('Live strings:', kuroko.gcstats()['objects']['str'])\n",
+		"<stdin>");
+
+	/* Collections the VM runs itself are counted, but only ours are timed. */
+	struct DemoGcStats after;
+	demo_gcStats(&gc);
+	krk_collectGarbage();
+	demo_collect();
+	demo_gcStats(&after);
+	DEMO_CHECK(after.collections == gc.collections + 2);
+	DEMO_CHECK(after.timedCollections == gc.timedCollections + 1);
+	checkScript(
+		"let stats = kuroko.gcstats()\n"
+		"assert stats['heap_size'] > 0 and stats['objects']['str'] > 0\n"
+		"assert stats['timed_collections'] > 0\n"
+		"assert stats['collections'] >= stats['timed_collections']\n");
+
+	/*
+	 * When running code you don't trust, @c guard.h can put a limit on
+	 * how much memory a snippet may allocate. A snippet that goes over
+	 * is interrupted - inside the snippet that looks like a
+	 * @c KeyboardInterrupt - and the host sees a @c MemoryError
+	 */
+	struct DemoGuard guard = { .maxBytes = 1024 * 1024 };
+	demo_interpretGuarded(
+		"def runaway():\n"
+		"  let hoard = []\n"
+		"  while True:\n"
+		"    hoard.append('x' * 100)\n"
+		"runaway()\n",
+		"<tenant>", &guard);
+	DEMO_CHECK((krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) &&
+		!strcmp(krk_typeName(krk_currentThread.currentException), "MemoryError"));
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
+		/* The traceback has been printed; clear the exception and move on. */
+		krk_currentThread.flags &= ~KRK_THREAD_HAS_EXCEPTION;
+		krk_currentThread.currentException = NONE_VAL();
+	}
+
+	/*
+	 * Guards can also limit how long a snippet, or a function called from
+	 * C with @c demo_callGuarded, may run. Code that runs out of time is
+	 * interrupted and the host sees a @c TimeoutError
+	 */
+	guard.timeout = 0.05;
+	demo_interpretGuarded("while True: pass", "<tenant>", &guard);
+	DEMO_CHECK((krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) &&
+		!strcmp(krk_typeName(krk_currentThread.currentException), "TimeoutError"));
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
+		krk_currentThread.flags &= ~KRK_THREAD_HAS_EXCEPTION;
+		krk_currentThread.currentException = NONE_VAL();
+	}
+	fprintf(stderr, "Guarded calls: %zu, over the limit: %zu, out of time: %zu, most allocated by one call %zu bytes.\n",
+		guard.calls, guard.exceeded, guard.timedOut, guard.peakBytes);
+	DEMO_CHECK(guard.calls == 2 && guard.exceeded == 1 && guard.timedOut == 1);
+	DEMO_CHECK(guard.peakBytes > guard.maxBytes);
+
+	/* Catching the interrupt once does not get a function out of its time limit. */
+	krk_interpret(
+		"def stubborn():\n"
+		"  try:\n"
+		"    while True: pass\n"
+		"  except KeyboardInterrupt:\n"
+		"    pass\n"
+		"  while True: pass\n",
+		"<tenant>");
+	struct DemoGuard stubborn = { .timeout = 0.05 };
+	demo_callGuarded(krk_valueGetAttribute(OBJECT_VAL(main_module), "stubborn"), 0, NULL, &stubborn);
+	DEMO_CHECK(stubborn.timedOut == 1);
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
+		krk_currentThread.flags &= ~KRK_THREAD_HAS_EXCEPTION;
+		krk_currentThread.currentException = NONE_VAL();
+	}
+
+	/*
+	 * The cache keeps its code objects alive, so clear it before
+	 * tearing down the VM.
+	 */
+	demo_snippetCacheClear();
+
+	/*
+	 * A string builder holds everything pushed to it until you write it
+	 * out, which is a lot of memory for a large report. The sink from
+	 * @c sink.h wraps a builder of bounded size and flushes it to a
+	 * @c FILE* or file descriptor whenever it fills up.
+	 */
+	struct DemoSink sink;
+	static struct DemoFormatPlan line_plan = DEMO_FORMAT("line %d of a streamed report\n");
+	demo_sinkInitFile(&sink, stderr, 256);
+	for (int i = 0; i < 3; ++i) {
+		if (!demo_sinkFormat(&sink, &line_plan, i)) break;
+	}
+	demo_sinkClose(&sink);
+
+	/*
+	 * Tracing with @c vm.callgrindFile records every call, which is too
+	 * slow to leave on. The sampling profiler from @c profiler.h instead
+	 * records the Kuroko call stack a few hundred times a second, and can
+	 * write what it saw as folded stacks for flame graph tools.
+	 */
+	demo_profilerStart(997, 0);
+	krk_interpret(
+		"def fib(n):\n"
+		"  return n if n < 2 else fib(n-1) + fib(n-2)\n"
+		"fib(25)\n",
+		"<stdin>");
+	demo_profilerStop();
+
+	struct DemoProfilerStats profile = demo_profilerStats();
+	fprintf(stderr, "Profiler took %zu samples:\n", profile.samples);
+	demo_profilerWriteFolded(stderr);
+
+	/*
+	 * Samples can also be counted by the function they landed in, giving
+	 * a cheap view of where time goes. The counts can be read from C with
+	 * @c demo_profilerFunctionCounts or bound into a module; let's look at
+	 * the busiest function from C, then put the rest in the @c kuroko
+	 * module.
+	 */
+	struct DemoProfilerFunction hottest;
+	if (demo_profilerFunctionCounts(&hottest, 1)) {
+		fprintf(stderr, "Busiest function: %s in %s (%zu samples)\n", hottest.name, hottest.file, hottest.samples);
+	}
+
+	demo_profilerBind(vm.system);
+	krk_interpret(
+		"import kuroko\n"
+		"print('Samples by function:', kuroko.function_counts())\n"
+		"kuroko.reset_counts()\n",
+		"<stdin>");
+
+	/*
+	 * Servers and tools that talk to many sockets or pipes at once want
+	 * to run their handlers as @c async @c def functions, without
+	 * blocking a thread on each descriptor. @c eventloop.h provides an
+	 * @c eventloop module whose @c run() drives those coroutines from
+	 * an epoll loop. Here, one task writes into a non-blocking pipe
+	 * while another waits for it to become readable.
+	 */
+	if (demo_eventLoopInit()) {
+		krk_interpret(
+			"import eventloop\n"
+			"async def producer(w):\n"
+			"  for word in [b'one', b'two', b'three']:\n"
+			"    await eventloop.sleep(0.01)\n"
+			"    await eventloop.writable(w)\n"
+			"    eventloop.write(w, word)\n"
+			"  eventloop.close(w)\n"
+			"async def consumer(r):\n"
+			"  while True:\n"
+			"    await eventloop.readable(r)\n"
+			"    let data = eventloop.read(r, 64)\n"
+			"    if data is None: continue\n"
+			"    if not data: break\n"
+			"    print('Read from pipe:', data)\n"
+			"  eventloop.close(r)\n"
+			"let r, w = eventloop.pipe()\n"
+			"eventloop.spawn(consumer(r))\n"
+			"eventloop.spawn(producer(w))\n"
+			"eventloop.run()\n",
+			"<stdin>");
+
+		/* Tasks and timers wake in deadline order, ties in the order they were made. */
+		checkScript(
+			"let order = []\n"
+			"async def after(delay, name):\n"
+			"  await eventloop.sleep(delay)\n"
+			"  order.append(name)\n"
+			"async def waiter():\n"
+			"  await eventloop.notified(7)\n"
+			"  order.append('notified')\n"
+			"async def notifier():\n"
+			"  await eventloop.sleep(0.04)\n"
+			"  eventloop.notify(7)\n"
+			"eventloop.spawn(after(0.03, 'c'))\n"
+			"eventloop.spawn(after(0.01, 'a'))\n"
+			"eventloop.spawn(after(0.01, 'b'))\n"
+			"eventloop.call_later(0.02, lambda: order.append('timer'))\n"
+			"eventloop.spawn(waiter())\n"
+			"eventloop.spawn(notifier())\n"
+			"eventloop.run()\n"
+			"assert order == ['a', 'b', 'timer', 'c', 'notified'], order\n"
+			"assert raises(eventloop.spawn, 42) is TypeError\n"
+			"let rp, wp = eventloop.pipe()\n"
+			"eventloop.write(wp, b'hi')\n"
+			"assert eventloop.read(rp, 1 << 40) == b'hi'\n"
+			"eventloop.close(rp)\n"
+			"eventloop.close(wp)\n");
+		demo_eventLoopShutdown();
+	} else {
+		krk_dumpTraceback();
+	}
+
 	/*
 	 * To free resources used by the VM, including all GC-managed objects,
 	 * call @c krk_freeVM - if you intend to re-use the VM, or if you will
@@ -404,6 +855,6 @@ int main(int argc, char *argv[]) {
 	 * running under tools like Valgrind, you should ensure that you do this.
 	 */
 	krk_freeVM();
-	return 0;
+	return failures ? 1 : 0;
 }
 
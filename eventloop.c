@@ -0,0 +1,735 @@
+/**
+ * @file eventloop.c
+ * @brief epoll-driven event loop for async Kuroko code.
+ *
+ * Tasks are plain coroutine objects. Calling one resumes it until its
+ * next suspension; a coroutine that has finished returns itself. The
+ * awaitables defined here suspend by yielding their @c Wait object all
+ * the way out to the loop, which parks the task on a timer, a file
+ * descriptor, or a notification key until it can continue.
+ *
+ * Everything the loop holds on to lives in plain C arrays, which are
+ * marked for the garbage collector by a root scanner from @c roots.h
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/vm.h>
+#include <kuroko/util.h>
+
+#include "eventloop.h"
+#include "roots.h"
+
+#define MAX_EVENTS 64
+
+/* read() returns at most this much at once, like any other short read. */
+#define MAX_READ (1 << 20)
+
+enum WaitKind {
+	WAIT_SLEEP,
+	WAIT_READ,
+	WAIT_WRITE,
+	WAIT_NOTIFY,
+};
+
+struct Wait {
+	KrkInstance inst;
+	int kind;
+	int fd;
+	double seconds;
+	krk_integer_type key;
+};
+
+struct WaitIter {
+	KrkInstance inst;
+	KrkValue wait;
+	int done;
+};
+
+struct FdWatch {
+	uint32_t registered;     /**< Events currently requested from epoll. */
+	KrkValue reader;         /**< Task waiting in readable(), or None */
+	KrkValue writer;         /**< Task waiting in writable(), or None */
+	uint32_t callbackEvents;
+	DemoFdCallback callback;
+	void * context;
+};
+
+struct Timer {
+	double when;
+	size_t seq;              /**< Keeps timers with the same deadline in order. */
+	KrkValue target;
+	int isTask;              /**< Resume @c target rather than call it. */
+};
+
+struct Notified {
+	krk_integer_type key;
+	KrkValue task;
+};
+
+static KrkClass * WaitClass = NULL;
+static KrkClass * WaitIterClass = NULL;
+
+static struct {
+	int epfd;
+	int wakefd;
+
+	KrkValue * ready;
+	size_t readyCount, readyCapacity;
+
+	struct FdWatch * fds;    /**< Indexed by descriptor. */
+	size_t fdCapacity;
+	size_t fdWaiters;        /**< Tasks parked on descriptors. */
+
+	struct Timer * timers;   /**< Binary min-heap on (when, seq) */
+	size_t timerCount, timerCapacity, timerSeq;
+
+	struct Notified * notified;
+	size_t notifiedCount, notifiedCapacity;
+
+	/* Filled by demo_eventLoopNotify from any thread. */
+	pthread_mutex_t lock;
+	krk_integer_type * pending;
+	size_t pendingCount, pendingCapacity;
+} loop = { .epfd = -1, .wakefd = -1, .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* Evaluates to 0, leaving the array as it was, if it is full and can not grow. */
+#define GROW(array, count, capacity) \
+	((count) < (capacity) || grow((void**)&(array), &(capacity), sizeof(*(array))))
+
+static int grow(void ** array, size_t * capacity, size_t size) {
+	size_t wanted = *capacity < 8 ? 8 : *capacity * 2;
+	void * grown = realloc(*array, size * wanted);
+	if (!grown) return 0;
+	*array = grown;
+	*capacity = wanted;
+	return 1;
+}
+
+/* Kuroko has no MemoryError of its own; find or make one, as guard.c does. */
+static KrkValue outOfMemory(void) {
+	static KrkClass * memoryError = NULL;
+	if (!memoryError) {
+		KrkValue existing;
+		if (krk_tableGet_fast(&vm.builtins->fields, S("MemoryError"), &existing) && IS_CLASS(existing)) {
+			memoryError = AS_CLASS(existing);
+		} else {
+			krk_makeClass(vm.builtins, &memoryError, "MemoryError", vm.exceptions->Exception);
+			krk_finalizeClass(memoryError);
+		}
+	}
+	return krk_runtimeError(memoryError, "out of memory in event loop");
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int wake(KrkValue task) {
+	if (!GROW(loop.ready, loop.readyCount, loop.readyCapacity)) {
+		outOfMemory();
+		return 0;
+	}
+	loop.ready[loop.readyCount++] = task;
+	return 1;
+}
+
+/* Timers */
+
+static int timerBefore(struct Timer * a, struct Timer * b) {
+	return a->when < b->when || (a->when == b->when && a->seq < b->seq);
+}
+
+static int pushTimer(double seconds, KrkValue target, int isTask) {
+	if (!GROW(loop.timers, loop.timerCount, loop.timerCapacity)) {
+		outOfMemory();
+		return 0;
+	}
+	size_t i = loop.timerCount++;
+	struct Timer timer = { now() + seconds, loop.timerSeq++, target, isTask };
+	while (i > 0) {
+		size_t parent = (i - 1) / 2;
+		if (!timerBefore(&timer, &loop.timers[parent])) break;
+		loop.timers[i] = loop.timers[parent];
+		i = parent;
+	}
+	loop.timers[i] = timer;
+	return 1;
+}
+
+static struct Timer popTimer(void) {
+	struct Timer top = loop.timers[0];
+	struct Timer last = loop.timers[--loop.timerCount];
+	size_t i = 0;
+	for (;;) {
+		size_t child = i * 2 + 1;
+		if (child >= loop.timerCount) break;
+		if (child + 1 < loop.timerCount && timerBefore(&loop.timers[child+1], &loop.timers[child])) child++;
+		if (!timerBefore(&loop.timers[child], &last)) break;
+		loop.timers[i] = loop.timers[child];
+		i = child;
+	}
+	if (loop.timerCount) loop.timers[i] = last;
+	return top;
+}
+
+/* Descriptors */
+
+/* Returns NULL, with MemoryError raised, if the table can not grow. */
+static struct FdWatch * fdWatch(int fd) {
+	if ((size_t)fd >= loop.fdCapacity) {
+		size_t old = loop.fdCapacity;
+		size_t wanted = (size_t)fd + 1 < old * 2 ? old * 2 : (size_t)fd + 1;
+		struct FdWatch * fds = realloc(loop.fds, sizeof(struct FdWatch) * wanted);
+		if (!fds) {
+			outOfMemory();
+			return NULL;
+		}
+		loop.fds = fds;
+		loop.fdCapacity = wanted;
+		for (size_t i = old; i < loop.fdCapacity; ++i) {
+			loop.fds[i] = (struct FdWatch){0, NONE_VAL(), NONE_VAL(), 0, NULL, NULL};
+		}
+	}
+	return &loop.fds[fd];
+}
+
+static int updateFd(int fd) {
+	struct FdWatch * watch = &loop.fds[fd];
+	uint32_t wanted = watch->callbackEvents;
+	if (!IS_NONE(watch->reader)) wanted |= EPOLLIN;
+	if (!IS_NONE(watch->writer)) wanted |= EPOLLOUT;
+	if (wanted == watch->registered) return 1;
+
+	struct epoll_event event = { .events = wanted, .data.fd = fd };
+	int op = !wanted ? EPOLL_CTL_DEL : !watch->registered ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+	if (epoll_ctl(loop.epfd, op, fd, &event) < 0 && op != EPOLL_CTL_DEL) return 0;
+	watch->registered = wanted;
+	return 1;
+}
+
+/* Returns 0, leaving the task parked, if it could not be woken. */
+static int dispatchFd(int fd, uint32_t events) {
+	struct FdWatch * watch = &loop.fds[fd];
+
+	/* Errors and hangups wake both directions so the task sees them in read/write. */
+	if (events & (EPOLLERR | EPOLLHUP)) events |= EPOLLIN | EPOLLOUT;
+
+	if ((events & EPOLLIN) && !IS_NONE(watch->reader)) {
+		if (!wake(watch->reader)) return 0;
+		watch->reader = NONE_VAL();
+		loop.fdWaiters--;
+	}
+	if ((events & EPOLLOUT) && !IS_NONE(watch->writer)) {
+		if (!wake(watch->writer)) return 0;
+		watch->writer = NONE_VAL();
+		loop.fdWaiters--;
+	}
+	updateFd(fd);
+
+	if (watch->callback && (events & watch->callbackEvents)) {
+		watch->callback(fd, events & watch->callbackEvents, watch->context);
+	}
+	return 1;
+}
+
+/* Notifications */
+
+/* Returns 0 if a task could not be woken; it stays parked. */
+static int drainNotifications(void) {
+	uint64_t count;
+	while (read(loop.wakefd, &count, sizeof(count)) > 0);
+
+	pthread_mutex_lock(&loop.lock);
+	krk_integer_type * keys = loop.pending;
+	size_t keyCount = loop.pendingCount;
+	loop.pending = NULL;
+	loop.pendingCount = loop.pendingCapacity = 0;
+	pthread_mutex_unlock(&loop.lock);
+
+	int ok = 1;
+	for (size_t k = 0; ok && k < keyCount; ++k) {
+		size_t kept = 0;
+		for (size_t i = 0; i < loop.notifiedCount; ++i) {
+			if (ok && loop.notified[i].key == keys[k] && (ok = wake(loop.notified[i].task))) continue;
+			loop.notified[kept++] = loop.notified[i];
+		}
+		loop.notifiedCount = kept;
+	}
+
+	free(keys);
+	return ok;
+}
+
+/* Tasks */
+
+static int park(KrkValue task, struct Wait * wait) {
+	switch (wait->kind) {
+		case WAIT_SLEEP:
+			return pushTimer(wait->seconds, task, 1);
+		case WAIT_READ:
+		case WAIT_WRITE: {
+			struct FdWatch * watch = fdWatch(wait->fd);
+			if (!watch) return 0;
+			KrkValue * slot = wait->kind == WAIT_READ ? &watch->reader : &watch->writer;
+			if (!IS_NONE(*slot)) {
+				krk_runtimeError(vm.exceptions->valueError, "another task is already waiting to %s fd %d",
+					wait->kind == WAIT_READ ? "read" : "write", wait->fd);
+				return 0;
+			}
+			*slot = task;
+			if (!updateFd(wait->fd)) {
+				*slot = NONE_VAL();
+				krk_runtimeError(vm.exceptions->ioError, "can not wait on fd %d: %s", wait->fd, strerror(errno));
+				return 0;
+			}
+			loop.fdWaiters++;
+			return 1;
+		}
+		case WAIT_NOTIFY:
+			if (!GROW(loop.notified, loop.notifiedCount, loop.notifiedCapacity)) {
+				outOfMemory();
+				return 0;
+			}
+			loop.notified[loop.notifiedCount++] = (struct Notified){wait->key, task};
+			return 1;
+	}
+	return 0;
+}
+
+static int step(KrkValue task) {
+	krk_push(task);
+	krk_push(task);
+	KrkValue result = krk_callStack(0);
+
+	int ok = !(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION);
+	if (ok && !krk_valuesSame(result, task)) {
+		if (krk_isInstanceOf(result, WaitClass)) {
+			ok = park(task, (struct Wait*)AS_OBJECT(result));
+		} else {
+			krk_runtimeError(vm.exceptions->typeError,
+				"task yielded '%T', expected an eventloop awaitable", result);
+			ok = 0;
+		}
+	}
+
+	krk_pop();
+	return ok;
+}
+
+static int runReady(void) {
+	/* Tasks woken while these run wait for the next pass. */
+	size_t count = loop.readyCount;
+	for (size_t i = 0; i < count; ++i) {
+		if (!step(loop.ready[i])) {
+			memmove(loop.ready, loop.ready + i + 1, sizeof(KrkValue) * (loop.readyCount - i - 1));
+			loop.readyCount -= i + 1;
+			return 0;
+		}
+	}
+	memmove(loop.ready, loop.ready + count, sizeof(KrkValue) * (loop.readyCount - count));
+	loop.readyCount -= count;
+	return 1;
+}
+
+static int runTimers(void) {
+	double current = now();
+	while (loop.timerCount && loop.timers[0].when <= current) {
+		struct Timer timer = popTimer();
+		if (timer.isTask) {
+			if (!wake(timer.target)) return 0;
+			continue;
+		}
+		krk_push(timer.target);
+		krk_callStack(0);
+		if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return 0;
+	}
+	return 1;
+}
+
+int demo_eventLoopRunOnce(double timeout) {
+	int ms = -1;
+	if (loop.readyCount) {
+		ms = 0;
+	} else {
+		double until = timeout;
+		if (loop.timerCount) {
+			double next = loop.timers[0].when - now();
+			if (next < 0) next = 0;
+			if (until < 0 || next < until) until = next;
+		}
+		/* Round up so a timer is never polled just before it is due. */
+		if (until >= 0) ms = (int)(until * 1000.0 + 0.999);
+	}
+
+	struct epoll_event events[MAX_EVENTS];
+	int count = epoll_wait(loop.epfd, events, MAX_EVENTS, ms);
+	if (count < 0) {
+		/* Interrupted by Ctrl-C or a guard: go back so the VM can raise. */
+		if (errno == EINTR && (krk_currentThread.flags & KRK_THREAD_SIGNALLED)) return 1;
+		if (errno != EINTR) {
+			krk_runtimeError(vm.exceptions->ioError, "epoll_wait: %s", strerror(errno));
+			return 0;
+		}
+		count = 0;
+	}
+
+	for (int i = 0; i < count; ++i) {
+		if (events[i].data.fd == loop.wakefd) {
+			if (!drainNotifications()) return 0;
+		} else {
+			if (!dispatchFd(events[i].data.fd, events[i].events)) return 0;
+		}
+	}
+
+	if (!runTimers()) return 0;
+	return runReady();
+}
+
+int demo_eventLoopRun(void) {
+	while (loop.readyCount || loop.timerCount || loop.fdWaiters || loop.notifiedCount) {
+		if (krk_currentThread.flags & KRK_THREAD_SIGNALLED) break;
+		if (!demo_eventLoopRunOnce(-1)) return 0;
+	}
+	return 1;
+}
+
+int demo_eventLoopSpawn(KrkValue coro) {
+	/* Coroutines are generator objects; anything else would fail at its first step. */
+	if (!krk_isInstanceOf(coro, vm.baseClasses->generatorClass)) {
+		krk_runtimeError(vm.exceptions->typeError, "expected a coroutine, not '%T'", coro);
+		return 0;
+	}
+	return wake(coro);
+}
+
+int demo_eventLoopNotify(krk_integer_type key) {
+	pthread_mutex_lock(&loop.lock);
+	if (!GROW(loop.pending, loop.pendingCount, loop.pendingCapacity)) {
+		pthread_mutex_unlock(&loop.lock);
+		return 0;
+	}
+	loop.pending[loop.pendingCount++] = key;
+	pthread_mutex_unlock(&loop.lock);
+
+	uint64_t one = 1;
+	while (write(loop.wakefd, &one, sizeof(one)) < 0 && errno == EINTR);
+	return 1;
+}
+
+int demo_eventLoopWatch(int fd, uint32_t events, DemoFdCallback callback, void * context) {
+	struct FdWatch * watch = fdWatch(fd);
+	if (!watch) return 0;
+	uint32_t previous = watch->callbackEvents;
+	watch->callbackEvents = events;
+	watch->callback = callback;
+	watch->context = context;
+	if (!updateFd(fd)) {
+		watch->callbackEvents = previous;
+		return 0;
+	}
+	return 1;
+}
+
+void demo_eventLoopUnwatch(int fd) {
+	if ((size_t)fd >= loop.fdCapacity) return;
+	loop.fds[fd].callbackEvents = 0;
+	loop.fds[fd].callback = NULL;
+	loop.fds[fd].context = NULL;
+	updateFd(fd);
+}
+
+/* Awaitables */
+
+static KrkValue newWait(int kind) {
+	struct Wait * wait = (struct Wait*)krk_newInstance(WaitClass);
+	wait->kind = kind;
+	wait->fd = -1;
+	return OBJECT_VAL(wait);
+}
+
+#define IS_Wait(o) (krk_isInstanceOf(o, WaitClass))
+#define AS_Wait(o) ((struct Wait*)AS_OBJECT(o))
+#define CURRENT_CTYPE struct Wait *
+#define CURRENT_NAME  self
+
+KRK_Method(Wait,__await__) {
+	struct WaitIter * iter = (struct WaitIter*)krk_newInstance(WaitIterClass);
+	iter->wait = argv[0];
+	return OBJECT_VAL(iter);
+}
+
+KRK_Method(Wait,__repr__) {
+	switch (self->kind) {
+		case WAIT_SLEEP:  return krk_stringFromFormat("<sleep %R>", FLOATING_VAL(self->seconds));
+		case WAIT_READ:   return krk_stringFromFormat("<readable %d>", self->fd);
+		case WAIT_WRITE:  return krk_stringFromFormat("<writable %d>", self->fd);
+		default:          return krk_stringFromFormat("<notified %d>", (int)self->key);
+	}
+}
+
+#undef CURRENT_CTYPE
+#define IS_WaitIter(o) (krk_isInstanceOf(o, WaitIterClass))
+#define AS_WaitIter(o) ((struct WaitIter*)AS_OBJECT(o))
+#define CURRENT_CTYPE struct WaitIter *
+
+/* The first call hands the Wait out to the loop; the second reports completion. */
+KRK_Method(WaitIter,__call__) {
+	if (self->done) return argv[0];
+	self->done = 1;
+	return self->wait;
+}
+
+KRK_Method(WaitIter,__finish__) {
+	return NONE_VAL();
+}
+
+static void _waititer_gcscan(KrkInstance * _self) {
+	krk_markValue(((struct WaitIter*)_self)->wait);
+}
+
+static void scanLoop(void) {
+	for (size_t i = 0; i < loop.readyCount; ++i) krk_markValue(loop.ready[i]);
+	for (size_t i = 0; i < loop.fdCapacity; ++i) {
+		krk_markValue(loop.fds[i].reader);
+		krk_markValue(loop.fds[i].writer);
+	}
+	for (size_t i = 0; i < loop.timerCount; ++i) krk_markValue(loop.timers[i].target);
+	for (size_t i = 0; i < loop.notifiedCount; ++i) krk_markValue(loop.notified[i].task);
+}
+
+/* Module functions */
+
+KRK_Function(spawn) {
+	FUNCTION_TAKES_EXACTLY(1);
+	if (!demo_eventLoopSpawn(argv[0])) return NONE_VAL();
+	return argv[0];
+}
+
+KRK_Function(run) {
+	FUNCTION_TAKES_NONE();
+	demo_eventLoopRun();
+	return NONE_VAL();
+}
+
+KRK_Function(run_once) {
+	double timeout = -1;
+	if (!krk_parseArgs("|d", (const char*[]){"timeout"}, &timeout)) return NONE_VAL();
+	demo_eventLoopRunOnce(timeout);
+	return NONE_VAL();
+}
+
+KRK_Function(call_later) {
+	double seconds;
+	KrkValue callback;
+	if (!krk_parseArgs("dV", (const char*[]){"seconds","callback"}, &seconds, &callback)) return NONE_VAL();
+	pushTimer(seconds, callback, 0);
+	return NONE_VAL();
+}
+
+KRK_Function(sleep) {
+	double seconds;
+	if (!krk_parseArgs("d", (const char*[]){"seconds"}, &seconds)) return NONE_VAL();
+	KrkValue wait = newWait(WAIT_SLEEP);
+	AS_Wait(wait)->seconds = seconds;
+	return wait;
+}
+
+static KrkValue fdWait(const char * _method_name, int argc, const KrkValue argv[], int hasKw, int kind) {
+	int fd;
+	if (!krk_parseArgs("i", (const char*[]){"fd"}, &fd)) return NONE_VAL();
+	if (fd < 0) return krk_runtimeError(vm.exceptions->valueError, "invalid fd %d", fd);
+	KrkValue wait = newWait(kind);
+	AS_Wait(wait)->fd = fd;
+	return wait;
+}
+
+KRK_Function(readable) {
+	return fdWait(_method_name, argc, argv, hasKw, WAIT_READ);
+}
+
+KRK_Function(writable) {
+	return fdWait(_method_name, argc, argv, hasKw, WAIT_WRITE);
+}
+
+KRK_Function(notified) {
+	krk_integer_type key;
+	if (!krk_parseArgs("L", (const char*[]){"key"}, &key)) return NONE_VAL();
+	KrkValue wait = newWait(WAIT_NOTIFY);
+	AS_Wait(wait)->key = key;
+	return wait;
+}
+
+KRK_Function(notify) {
+	krk_integer_type key;
+	if (!krk_parseArgs("L", (const char*[]){"key"}, &key)) return NONE_VAL();
+	if (!demo_eventLoopNotify(key)) return outOfMemory();
+	return NONE_VAL();
+}
+
+KRK_Function(pipe) {
+	FUNCTION_TAKES_NONE();
+	int fds[2];
+	if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+		return krk_runtimeError(vm.exceptions->ioError, "pipe: %s", strerror(errno));
+	}
+	return OBJECT_VAL(krk_tuple_of(2, (KrkValue[]){INTEGER_VAL(fds[0]), INTEGER_VAL(fds[1])}, 0));
+}
+
+KRK_Function(set_nonblocking) {
+	int fd;
+	if (!krk_parseArgs("i", (const char*[]){"fd"}, &fd)) return NONE_VAL();
+	int flags = fcntl(fd, F_GETFL);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+		return krk_runtimeError(vm.exceptions->ioError, "fd %d: %s", fd, strerror(errno));
+	}
+	return NONE_VAL();
+}
+
+/* read() and write() return None instead of blocking. */
+KRK_Function(read) {
+	int fd;
+	krk_integer_type size;
+	if (!krk_parseArgs("iL", (const char*[]){"fd","size"}, &fd, &size)) return NONE_VAL();
+	if (size < 0) return krk_runtimeError(vm.exceptions->valueError, "size must be non-negative");
+	if (size > MAX_READ) size = MAX_READ;
+
+	void * buffer = malloc(size ? size : 1);
+	if (!buffer) return outOfMemory();
+	ssize_t got;
+	while ((got = read(fd, buffer, size)) < 0 && errno == EINTR);
+	if (got < 0) {
+		free(buffer);
+		if (errno == EAGAIN || errno == EWOULDBLOCK) return NONE_VAL();
+		return krk_runtimeError(vm.exceptions->ioError, "read: %s", strerror(errno));
+	}
+
+	KrkBytes * bytes = krk_newBytes(got, buffer);
+	free(buffer);
+	return OBJECT_VAL(bytes);
+}
+
+KRK_Function(write) {
+	int fd;
+	KrkBytes * data;
+	if (!krk_parseArgs("iO!", (const char*[]){"fd","data"}, &fd, vm.baseClasses->bytesClass, &data)) return NONE_VAL();
+
+	ssize_t wrote;
+	while ((wrote = write(fd, data->bytes, data->length)) < 0 && errno == EINTR);
+	if (wrote < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK) return NONE_VAL();
+		return krk_runtimeError(vm.exceptions->ioError, "write: %s", strerror(errno));
+	}
+	return INTEGER_VAL(wrote);
+}
+
+KRK_Function(close) {
+	int fd;
+	if (!krk_parseArgs("i", (const char*[]){"fd"}, &fd)) return NONE_VAL();
+
+	/* Closing removes the descriptor from epoll; forget it here too, and
+	 * let any task still waiting on it find out from read() or write() */
+	if ((size_t)fd < loop.fdCapacity && loop.fds[fd].registered) {
+		epoll_ctl(loop.epfd, EPOLL_CTL_DEL, fd, NULL);
+		loop.fds[fd].registered = 0;
+		loop.fds[fd].callbackEvents = 0;
+		loop.fds[fd].callback = NULL;
+		dispatchFd(fd, EPOLLIN | EPOLLOUT);
+	}
+	if (close(fd) < 0) return krk_runtimeError(vm.exceptions->ioError, "close: %s", strerror(errno));
+	return NONE_VAL();
+}
+
+KrkInstance * demo_eventLoopInit(void) {
+	if (loop.epfd >= 0) {
+		krk_runtimeError(vm.exceptions->valueError, "event loop is already initialized");
+		return NULL;
+	}
+
+	int epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0) {
+		krk_runtimeError(vm.exceptions->ioError, "epoll_create1: %s", strerror(errno));
+		return NULL;
+	}
+	int wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	struct epoll_event event = { .events = EPOLLIN, .data.fd = wakefd };
+	if (wakefd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &event) < 0) {
+		krk_runtimeError(vm.exceptions->ioError, "eventfd: %s", strerror(errno));
+		if (wakefd >= 0) close(wakefd);
+		close(epfd);
+		return NULL;
+	}
+	loop.epfd = epfd;
+	loop.wakefd = wakefd;
+
+	KrkInstance * module = krk_newInstance(vm.baseClasses->moduleClass);
+	krk_push(OBJECT_VAL(module));
+	krk_attachNamedObject(&vm.modules, "eventloop", (KrkObj*)module);
+	krk_attachNamedObject(&module->fields, "__name__", (KrkObj*)S("eventloop"));
+	krk_attachNamedValue(&module->fields, "__file__", NONE_VAL());
+
+	KrkClass * Wait = krk_makeClass(module, &WaitClass, "Wait", vm.baseClasses->objectClass);
+	Wait->allocSize = sizeof(struct Wait);
+	BIND_METHOD(Wait,__await__);
+	BIND_METHOD(Wait,__repr__);
+	krk_finalizeClass(Wait);
+
+	KrkClass * WaitIter = krk_makeClass(module, &WaitIterClass, "WaitIter", vm.baseClasses->objectClass);
+	WaitIter->allocSize = sizeof(struct WaitIter);
+	WaitIter->_ongcscan = _waititer_gcscan;
+	BIND_METHOD(WaitIter,__call__);
+	BIND_METHOD(WaitIter,__finish__);
+	krk_finalizeClass(WaitIter);
+
+	demo_addRootScanner(scanLoop);
+
+	BIND_FUNC(module,spawn);
+	BIND_FUNC(module,run);
+	BIND_FUNC(module,run_once);
+	BIND_FUNC(module,call_later);
+	BIND_FUNC(module,sleep);
+	BIND_FUNC(module,readable);
+	BIND_FUNC(module,writable);
+	BIND_FUNC(module,notified);
+	BIND_FUNC(module,notify);
+	BIND_FUNC(module,pipe);
+	BIND_FUNC(module,set_nonblocking);
+	BIND_FUNC(module,read);
+	BIND_FUNC(module,write);
+	BIND_FUNC(module,close);
+
+	krk_pop();
+	return module;
+}
+
+void demo_eventLoopShutdown(void) {
+	if (loop.epfd >= 0) close(loop.epfd);
+	if (loop.wakefd >= 0) close(loop.wakefd);
+	loop.epfd = loop.wakefd = -1;
+
+	free(loop.ready);
+	free(loop.fds);
+	free(loop.timers);
+	free(loop.notified);
+	free(loop.pending);
+	loop.ready = NULL;
+	loop.fds = NULL;
+	loop.timers = NULL;
+	loop.notified = NULL;
+	loop.pending = NULL;
+	loop.readyCount = loop.readyCapacity = 0;
+	loop.fdCapacity = loop.fdWaiters = 0;
+	loop.timerCount = loop.timerCapacity = 0;
+	loop.notifiedCount = loop.notifiedCapacity = 0;
+	loop.pendingCount = loop.pendingCapacity = 0;
+}
@@ -0,0 +1,108 @@
+/**
+ * @file eventloop.h
+ * @brief epoll-driven event loop for async Kuroko code.
+ *
+ * @c demo_eventLoopInit creates an @c eventloop module that runs
+ * @c async @c def coroutines as tasks on a single thread. A task that
+ * waits on a timer, a file descriptor, or a notification yields back to
+ * the loop, which uses epoll to sleep until something is ready, so one
+ * OS thread can serve many tasks blocked on I/O.
+ *
+ * From Kuroko:
+ *
+ * @code
+ * import eventloop
+ * async def echo(fd):
+ *     await eventloop.readable(fd)
+ *     print(eventloop.read(fd, 1024))
+ * eventloop.spawn(echo(fd))
+ * eventloop.run()
+ * @endcode
+ *
+ * The module provides @c spawn(coro), @c run(), @c run_once(timeout),
+ * @c call_later(seconds,callback), the awaitables @c sleep(seconds),
+ * @c readable(fd), @c writable(fd), and @c notified(key), plus
+ * @c notify(key) and a few non-blocking I/O helpers: @c pipe(),
+ * @c set_nonblocking(fd), @c read(fd,n), @c write(fd,data), @c close(fd).
+ * @c read returns at most 1 MiB at a time.
+ *
+ * The host can watch its own descriptors with C callbacks, drive the
+ * loop itself, and wake tasks waiting in @c notified(key) from any
+ * thread with @c demo_eventLoopNotify
+ */
+#pragma once
+
+#include <stdint.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/value.h>
+#include <kuroko/object.h>
+
+typedef void (*DemoFdCallback)(int fd, uint32_t events, void * context);
+
+/**
+ * @brief Create the loop and register the @c eventloop module.
+ *
+ * Must be called after @c krk_initVM. Returns NULL, with an exception
+ * set, if the loop already exists or its epoll and eventfd descriptors
+ * can not be created. After @c demo_eventLoopShutdown it may be called
+ * again.
+ */
+extern KrkInstance * demo_eventLoopInit(void);
+
+/**
+ * @brief Release the loop's descriptors and queues.
+ *
+ * Pending tasks are dropped. Call before @c krk_freeVM
+ */
+extern void demo_eventLoopShutdown(void);
+
+/**
+ * @brief Call @p callback whenever @p fd has any of @p events
+ *
+ * @p events are @c EPOLLIN / @c EPOLLOUT flags. Watches stay until
+ * @c demo_eventLoopUnwatch; they do not keep @c run() going on their own.
+ * Returns 0 if the descriptor could not be added to epoll.
+ */
+extern int demo_eventLoopWatch(int fd, uint32_t events, DemoFdCallback callback, void * context);
+
+/**
+ * @brief Stop calling the callback registered for @p fd
+ */
+extern void demo_eventLoopUnwatch(int fd);
+
+/**
+ * @brief Schedule a coroutine to run as a task.
+ *
+ * Returns 0, with @c TypeError raised, if @p coro is not a coroutine
+ * object, or with @c MemoryError raised if it could not be queued.
+ */
+extern int demo_eventLoopSpawn(KrkValue coro);
+
+/**
+ * @brief Wake every task waiting in @c notified(key)
+ *
+ * Safe to call from any thread. Returns 0, without raising, if the
+ * notification could not be queued for lack of memory.
+ */
+extern int demo_eventLoopNotify(krk_integer_type key);
+
+/**
+ * @brief Wait for events for up to @p timeout seconds, then run
+ *        everything that became ready.
+ *
+ * A negative @p timeout waits until something happens.
+ * Returns 0 if a task or callback raised an exception, which is left set.
+ * If the wait is interrupted by a signal that sets
+ * @c KRK_THREAD_SIGNALLED, such as Ctrl-C or a limit from @c guard.h,
+ * returns 1 right away without running anything; the VM raises the
+ * interrupt the next time it runs.
+ */
+extern int demo_eventLoopRunOnce(double timeout);
+
+/**
+ * @brief Run until no tasks are ready, sleeping, or waiting.
+ *
+ * Returns 0 if a task or callback raised an exception, which is left set.
+ * Stops early, returning 1, once @c KRK_THREAD_SIGNALLED is set.
+ */
+extern int demo_eventLoopRun(void);
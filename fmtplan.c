@@ -0,0 +1,166 @@
+/**
+ * @file fmtplan.c
+ * @brief Precompiled format plans for string builders.
+ */
+#include <pthread.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/types.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/vm.h>
+#include <kuroko/util.h>
+
+#include "fmtplan.h"
+
+/* Rough space to reserve for each conversion; only a hint. */
+#define CONVERSION_HINT 24
+
+/* Plans are compiled on first use, which may happen on several threads at once. */
+static pthread_mutex_t compileLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void addStep(struct DemoFormatPlan * plan, struct DemoFormatStep step) {
+	if (plan->count == DEMO_FORMAT_MAX) {
+		plan->slow = 1;
+		return;
+	}
+	plan->steps[plan->count++] = step;
+	plan->sizeHint += step.conversion ? CONVERSION_HINT : step.length;
+}
+
+static void compilePlan(struct DemoFormatPlan * plan) {
+	const char * f = plan->format;
+	const char * run = f;
+
+	while (*f && !plan->slow) {
+		if (*f != '%') {
+			f++;
+			continue;
+		}
+
+		if (f > run) addStep(plan, (struct DemoFormatStep){0, 0, run - plan->format, f - run});
+		f++;
+
+		char size = 0;
+		if (*f == 'l' || *f == 'L' || *f == 'z') size = *f++;
+
+		switch (*f) {
+			case '%':
+				/* Start the next literal run with the percent sign itself. */
+				if (size) plan->slow = 1;
+				run = f++;
+				continue;
+			case 'd': case 'u':
+				break;
+			case 's': case 'c': case 'p': case 'T': case 'R':
+				if (size) plan->slow = 1;
+				break;
+			default:
+				plan->slow = 1;
+				continue;
+		}
+
+		addStep(plan, (struct DemoFormatStep){*f, size, 0, 0});
+		run = ++f;
+	}
+
+	if (f > run) addStep(plan, (struct DemoFormatStep){0, 0, run - plan->format, f - run});
+	__atomic_store_n(&plan->ready, 1, __ATOMIC_RELEASE);
+}
+
+void demo_reserveStringBuilder(struct StringBuilder * sb, size_t extra) {
+	if (sb->capacity >= sb->length + extra) return;
+	size_t old = sb->capacity;
+	size_t capacity = GROW_CAPACITY(old);
+	if (capacity < sb->length + extra) capacity = sb->length + extra;
+	sb->bytes = GROW_ARRAY(char, sb->bytes, old, capacity);
+	sb->capacity = capacity;
+}
+
+static void pushUnsigned(struct StringBuilder * sb, unsigned long long value, int negative) {
+	char tmp[24];
+	char * end = tmp + sizeof(tmp);
+	char * c = end;
+	do {
+		*--c = '0' + (value % 10);
+		value /= 10;
+	} while (value);
+	if (negative) *--c = '-';
+	krk_pushStringBuilderStr(sb, c, end - c);
+}
+
+static void pushSigned(struct StringBuilder * sb, long long value) {
+	if (value < 0) {
+		pushUnsigned(sb, -(unsigned long long)value, 1);
+	} else {
+		pushUnsigned(sb, value, 0);
+	}
+}
+
+int demo_pushFormatV(struct StringBuilder * sb, struct DemoFormatPlan * plan, va_list args) {
+	if (!__atomic_load_n(&plan->ready, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_lock(&compileLock);
+		if (!plan->ready) compilePlan(plan);
+		pthread_mutex_unlock(&compileLock);
+	}
+	if (plan->slow) return krk_pushStringBuilderFormatV(sb, plan->format, args);
+
+	demo_reserveStringBuilder(sb, plan->sizeHint);
+
+	for (size_t i = 0; i < plan->count; ++i) {
+		struct DemoFormatStep * step = &plan->steps[i];
+		switch (step->conversion) {
+			case 0:
+				krk_pushStringBuilderStr(sb, plan->format + step->offset, step->length);
+				break;
+			case 'd':
+				switch (step->size) {
+					case 'l': pushSigned(sb, va_arg(args, long)); break;
+					case 'L': pushSigned(sb, va_arg(args, long long)); break;
+					case 'z': pushSigned(sb, va_arg(args, ssize_t)); break;
+					default:  pushSigned(sb, va_arg(args, int)); break;
+				}
+				break;
+			case 'u':
+				switch (step->size) {
+					case 'l': pushUnsigned(sb, va_arg(args, unsigned long), 0); break;
+					case 'L': pushUnsigned(sb, va_arg(args, unsigned long long), 0); break;
+					case 'z': pushUnsigned(sb, va_arg(args, size_t), 0); break;
+					default:  pushUnsigned(sb, va_arg(args, unsigned int), 0); break;
+				}
+				break;
+			case 's': {
+				const char * str = va_arg(args, const char*);
+				krk_pushStringBuilderStr(sb, str, strlen(str));
+				break;
+			}
+			case 'c':
+				krk_pushStringBuilder(sb, (char)va_arg(args, int));
+				break;
+			case 'p':
+			case 'R':
+				/* Pointers are rare and repr() may call back into the VM;
+				 * either way the single-conversion format is cheap to scan. */
+				if (step->conversion == 'p') {
+					if (!krk_pushStringBuilderFormat(sb, "%p", va_arg(args, void*))) return 0;
+				} else {
+					if (!krk_pushStringBuilderFormat(sb, "%R", va_arg(args, KrkValue))) return 0;
+				}
+				break;
+			case 'T': {
+				const char * name = krk_typeName(va_arg(args, KrkValue));
+				krk_pushStringBuilderStr(sb, name, strlen(name));
+				break;
+			}
+		}
+	}
+
+	return 1;
+}
+
+int demo_pushFormat(struct StringBuilder * sb, struct DemoFormatPlan * plan, ...) {
+	va_list args;
+	va_start(args, plan);
+	int result = demo_pushFormatV(sb, plan, args);
+	va_end(args);
+	return result;
+}
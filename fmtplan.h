@@ -0,0 +1,72 @@
+/**
+ * @file fmtplan.h
+ * @brief Precompiled format plans for string builders.
+ *
+ * @c krk_pushStringBuilderFormat scans its format string on every call.
+ * A @c DemoFormatPlan is compiled from the same format string once, on
+ * first use, into a list of literal runs and conversions. Pushing with
+ * a plan copies the literal runs directly, converts each argument
+ * without looking at the format again, and reserves enough space up
+ * front that the builder normally grows at most once. Compilation takes
+ * a lock, so a plan can be shared by code running on several threads.
+ *
+ * @code
+ * static struct DemoFormatPlan plan = DEMO_FORMAT("the value %d, ");
+ * if (!demo_pushFormat(&sb, &plan, b)) return NONE_VAL();
+ * @endcode
+ *
+ * Plans accept the same conversions as @c krk_pushStringBuilderFormat:
+ * @c %d and @c %u with the @c l, @c L and @c z size modifiers, @c %s,
+ * @c %c, @c %p, @c %T, @c %R, and @c %%. A format with anything else is
+ * passed to @c krk_pushStringBuilderFormatV unchanged.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdarg.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/util.h>
+
+#define DEMO_FORMAT_MAX 16
+
+struct DemoFormatStep {
+	char conversion;  /**< 0 for a literal run, otherwise the conversion character. */
+	char size;        /**< Size modifier for integer conversions, or 0. */
+	size_t offset;    /**< Start of a literal run within the format. */
+	size_t length;    /**< Length of a literal run. */
+};
+
+/**
+ * @brief Compiled format. Build with @c DEMO_FORMAT
+ */
+struct DemoFormatPlan {
+	const char * format;
+	int ready;           /**< Set once the plan has been compiled. */
+	int slow;            /**< Format needs krk_pushStringBuilderFormatV */
+	size_t count;        /**< Number of steps. */
+	size_t sizeHint;     /**< Bytes to reserve before pushing. */
+	struct DemoFormatStep steps[DEMO_FORMAT_MAX];
+};
+
+/**
+ * @brief Static initializer for a @c DemoFormatPlan
+ */
+#define DEMO_FORMAT(fmt) { .format = fmt }
+
+/**
+ * @brief Ensure @p sb can take @p extra more bytes without growing.
+ */
+extern void demo_reserveStringBuilder(struct StringBuilder * sb, size_t extra);
+
+/**
+ * @brief Append formatted output to @p sb using a precompiled plan.
+ *
+ * Returns 1 on success, or 0 if a conversion raised an exception, just
+ * like @c krk_pushStringBuilderFormat
+ */
+extern int demo_pushFormat(struct StringBuilder * sb, struct DemoFormatPlan * plan, ...);
+
+/**
+ * @brief @c va_list variant of @c demo_pushFormat
+ */
+extern int demo_pushFormatV(struct StringBuilder * sb, struct DemoFormatPlan * plan, va_list args);
@@ -0,0 +1,26 @@
+/**
+ * @file gcscope.c
+ * @brief Collect after a scope.
+ */
+#include <kuroko/kuroko.h>
+#include <kuroko/vm.h>
+
+#include "gcscope.h"
+#include "gcstats.h"
+
+void demo_gcScopeOpen(struct DemoGcScope * scope, unsigned int percent) {
+	if (!percent) percent = 50;
+	size_t room = vm.nextGC > vm.bytesAllocated ? vm.nextGC - vm.bytesAllocated : 0;
+	scope->threshold = (size_t)((double)room * percent / 100.0);
+	scope->start = vm.bytesAllocated;
+	scope->grown = 0;
+	scope->freed = 0;
+}
+
+size_t demo_gcScopeClose(struct DemoGcScope * scope) {
+	/* A collection inside the scope may have shrunk the heap below where
+	 * it started; that counts as no growth. */
+	scope->grown = vm.bytesAllocated > scope->start ? vm.bytesAllocated - scope->start : 0;
+	scope->freed = scope->grown > scope->threshold ? demo_collect() : 0;
+	return scope->freed;
+}
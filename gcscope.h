@@ -0,0 +1,59 @@
+/**
+ * @file gcscope.h
+ * @brief Collect after a scope.
+ *
+ * Objects created while handling one request usually become garbage as
+ * soon as it finishes, but they stay allocated until the collector next
+ * runs, which may be in the middle of some later request. Wrapping each
+ * request in a @c DemoGcScope records how much the heap grew while it
+ * ran; closing the scope runs a full collection right away if the
+ * request used up a good share of the room left before the VM's next
+ * collection, so memory stays flat from one request to the next and the
+ * collection happens between requests rather than during one. The
+ * threshold is relative to that room, which grows with the heap, so
+ * hosts with large heaps do not pay for a full collection after every
+ * small request.
+ *
+ * @code
+ * struct DemoGcScope scope;
+ * demo_gcScopeOpen(&scope, 0);
+ * krk_interpret(request, "<request>");
+ * demo_gcScopeClose(&scope);
+ * @endcode
+ *
+ * This is not region allocation: objects made inside the scope come
+ * from the same heap as everything else, and are only freed by an
+ * ordinary mark and sweep of the whole heap. Anything still reachable
+ * when the scope closes, such as values stored in module globals,
+ * survives that collection as usual.
+ */
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * @brief State for one scope.
+ */
+struct DemoGcScope {
+	size_t threshold;  /**< Collect on close if the heap grew more than this many bytes. */
+	size_t start;      /**< Heap size when the scope was opened. */
+	size_t grown;      /**< Heap growth while the scope was open, set on close. */
+	size_t freed;      /**< Bytes freed by the collection on close, if any. */
+};
+
+/**
+ * @brief Open a scope.
+ *
+ * @param percent Heap growth, as a percentage of the room left before
+ *                the VM's next collection when the scope opens, that
+ *                triggers a collection on close; 0 selects 50.
+ */
+extern void demo_gcScopeOpen(struct DemoGcScope * scope, unsigned int percent);
+
+/**
+ * @brief Close a scope, collecting garbage if it grew too much.
+ *
+ * @return Bytes freed, or 0 if no collection was needed.
+ */
+extern size_t demo_gcScopeClose(struct DemoGcScope * scope);
+
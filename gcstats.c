@@ -0,0 +1,206 @@
+/**
+ * @file gcstats.c
+ * @brief Garbage collector and heap statistics.
+ */
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/vm.h>
+#include <kuroko/memory.h>
+#include <kuroko/util.h>
+
+#include "gcstats.h"
+#include "roots.h"
+
+const char * demo_gcTypeNames[DEMO_GC_TYPE_COUNT] = {
+	[DEMO_GC_CODEOBJECT]   = "codeobject",
+	[DEMO_GC_NATIVE]       = "native",
+	[DEMO_GC_CLOSURE]      = "closure",
+	[DEMO_GC_STRING]       = "str",
+	[DEMO_GC_UPVALUE]      = "upvalue",
+	[DEMO_GC_CLASS]        = "class",
+	[DEMO_GC_INSTANCE]     = "instance",
+	[DEMO_GC_BOUND_METHOD] = "method",
+	[DEMO_GC_TUPLE]        = "tuple",
+	[DEMO_GC_BYTES]        = "bytes",
+	[DEMO_GC_OTHER]        = "other",
+};
+
+static struct {
+	size_t collections;
+	size_t timedCollections;
+	size_t liveAfterLast;
+	size_t freedTotal;
+	double pauseTotal;
+	double pauseMax;
+} counters = {0};
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Runs once per mark phase, whoever started the collection. */
+static void countCollection(void) {
+	__atomic_add_fetch(&counters.collections, 1, __ATOMIC_RELAXED);
+}
+
+void demo_gcStatsInit(void) {
+	demo_addRootScanner(countCollection);
+}
+
+size_t demo_collect(void) {
+	demo_gcStatsInit();
+	double start = now();
+	size_t freed = krk_collectGarbage();
+	double pause = now() - start;
+
+	counters.timedCollections++;
+	counters.freedTotal += freed;
+	counters.pauseTotal += pause;
+	if (pause > counters.pauseMax) counters.pauseMax = pause;
+	counters.liveAfterLast = vm.bytesAllocated;
+	return freed;
+}
+
+static enum DemoGcType classify(KrkObj * obj) {
+	switch (obj->type) {
+		case KRK_OBJ_CODEOBJECT:   return DEMO_GC_CODEOBJECT;
+		case KRK_OBJ_NATIVE:       return DEMO_GC_NATIVE;
+		case KRK_OBJ_CLOSURE:      return DEMO_GC_CLOSURE;
+		case KRK_OBJ_STRING:       return DEMO_GC_STRING;
+		case KRK_OBJ_UPVALUE:      return DEMO_GC_UPVALUE;
+		case KRK_OBJ_CLASS:        return DEMO_GC_CLASS;
+		case KRK_OBJ_INSTANCE:     return DEMO_GC_INSTANCE;
+		case KRK_OBJ_BOUND_METHOD: return DEMO_GC_BOUND_METHOD;
+		case KRK_OBJ_TUPLE:        return DEMO_GC_TUPLE;
+		case KRK_OBJ_BYTES:        return DEMO_GC_BYTES;
+		default:                   return DEMO_GC_OTHER;
+	}
+}
+
+void demo_gcStats(struct DemoGcStats * stats) {
+	stats->heapSize = vm.bytesAllocated;
+	stats->nextCollection = vm.nextGC;
+	stats->collections = __atomic_load_n(&counters.collections, __ATOMIC_RELAXED);
+	stats->timedCollections = counters.timedCollections;
+	stats->liveAfterLast = counters.liveAfterLast;
+	stats->freedTotal = counters.freedTotal;
+	stats->pauseTotal = counters.pauseTotal;
+	stats->pauseMax = counters.pauseMax;
+
+	for (int i = 0; i < DEMO_GC_TYPE_COUNT; ++i) stats->objects[i] = 0;
+	for (KrkObj * obj = vm.objects; obj; obj = obj->next) {
+		stats->objects[classify(obj)]++;
+	}
+}
+
+static int compareClasses(const void * a, const void * b) {
+	const struct DemoGcClassCount * x = a, * y = b;
+	if (x->cls != y->cls) return x->cls < y->cls ? -1 : 1;
+	return 0;
+}
+
+static int compareCounts(const void * a, const void * b) {
+	const struct DemoGcClassCount * x = a, * y = b;
+	return (x->count < y->count) - (x->count > y->count);
+}
+
+size_t demo_gcInstanceCounts(struct DemoGcClassCount * out, size_t max) {
+	size_t count = 0;
+	for (KrkObj * obj = vm.objects; obj; obj = obj->next) {
+		if (obj->type == KRK_OBJ_INSTANCE) count++;
+	}
+	struct DemoGcClassCount * all = malloc((count ? count : 1) * sizeof(struct DemoGcClassCount));
+	if (!all) return 0;
+	size_t filled = 0;
+	for (KrkObj * obj = vm.objects; obj && filled < count; obj = obj->next) {
+		if (obj->type != KRK_OBJ_INSTANCE) continue;
+		all[filled].cls = ((KrkInstance*)obj)->_class;
+		all[filled].count = 1;
+		filled++;
+	}
+
+	/* Merge instances of the same class, then put the most common first. */
+	qsort(all, count, sizeof(struct DemoGcClassCount), compareClasses);
+	size_t distinct = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (distinct && all[distinct - 1].cls == all[i].cls) {
+			all[distinct - 1].count++;
+		} else {
+			all[distinct++] = all[i];
+		}
+	}
+	qsort(all, distinct, sizeof(struct DemoGcClassCount), compareCounts);
+
+	if (out && max) memcpy(out, all, (distinct < max ? distinct : max) * sizeof(struct DemoGcClassCount));
+	free(all);
+	return distinct;
+}
+
+KRK_Function(gcstats) {
+	/* Take the snapshot first, so the dict we build is not counted. */
+	struct DemoGcStats stats;
+	demo_gcStats(&stats);
+	size_t classCount = demo_gcInstanceCounts(NULL, 0);
+	struct DemoGcClassCount * classes = malloc((classCount ? classCount : 1) * sizeof(struct DemoGcClassCount));
+	if (!classes) return krk_runtimeError(vm.exceptions->Exception, "out of memory");
+	classCount = demo_gcInstanceCounts(classes, classCount);
+
+	/*
+	 * Some of those instances, and their classes, may be garbage that the
+	 * allocations below collect, so copy the class names out first.
+	 */
+	char ** names = calloc(classCount ? classCount : 1, sizeof(char*));
+	for (size_t i = 0; names && i < classCount; ++i) {
+		names[i] = strdup(classes[i].cls->name->chars);
+	}
+
+	KrkValue objects = krk_dict_of(0, NULL, 0);
+	krk_push(objects);
+	for (int i = 0; i < DEMO_GC_TYPE_COUNT; ++i) {
+		if (i == DEMO_GC_INSTANCE) continue;
+		krk_attachNamedValue(AS_DICT(objects), demo_gcTypeNames[i], INTEGER_VAL(stats.objects[i]));
+	}
+
+	/*
+	 * Instances go under their class name. Classes can share a name, and
+	 * a class can be named like one of the types above, so add to any
+	 * count that is already there.
+	 */
+	for (size_t i = 0; i < classCount; ++i) {
+		const char * name = names && names[i] ? names[i] : demo_gcTypeNames[DEMO_GC_INSTANCE];
+		krk_push(OBJECT_VAL(krk_copyString(name, strlen(name))));
+		KrkValue existing = INTEGER_VAL(0);
+		krk_tableGet(AS_DICT(objects), krk_peek(0), &existing);
+		krk_tableSet(AS_DICT(objects), krk_peek(0), INTEGER_VAL(AS_INTEGER(existing) + classes[i].count));
+		krk_pop();
+		if (names) free(names[i]);
+	}
+	free(names);
+	free(classes);
+
+	KrkValue dict = krk_dict_of(0, NULL, 0);
+	krk_push(dict);
+	KrkTable * out = AS_DICT(dict);
+	krk_attachNamedValue(out, "heap_size", INTEGER_VAL(stats.heapSize));
+	krk_attachNamedValue(out, "next_collection", INTEGER_VAL(stats.nextCollection));
+	krk_attachNamedValue(out, "collections", INTEGER_VAL(stats.collections));
+	krk_attachNamedValue(out, "timed_collections", INTEGER_VAL(stats.timedCollections));
+	krk_attachNamedValue(out, "live_after_last", INTEGER_VAL(stats.liveAfterLast));
+	krk_attachNamedValue(out, "freed_total", INTEGER_VAL(stats.freedTotal));
+	krk_attachNamedValue(out, "pause_total", FLOATING_VAL(stats.pauseTotal));
+	krk_attachNamedValue(out, "pause_max", FLOATING_VAL(stats.pauseMax));
+	krk_attachNamedValue(out, "objects", objects);
+
+	krk_pop();
+	krk_pop();
+	return dict;
+}
+
+void demo_gcStatsBind(KrkInstance * module) {
+	demo_gcStatsInit();
+	BIND_FUNC(module,gcstats);
+}
@@ -0,0 +1,117 @@
+/**
+ * @file gcstats.h
+ * @brief Garbage collector and heap statistics.
+ *
+ * Reports the VM's heap size and collection threshold, counts live
+ * objects by type, and counts collections. Every collection is counted,
+ * including the ones the VM starts on its own when the heap reaches its
+ * threshold, by a scanner registered with @c demo_addRootScanner; call
+ * @c demo_gcStatsInit right after @c krk_initVM so none are missed.
+ *
+ * Those automatic collections happen inside the allocator and can not
+ * be timed from here. Pause times, bytes freed, and the heap size after
+ * a collection only cover collections run through @c demo_collect (as
+ * the helpers in @c gcscope.h do).
+ *
+ * libkuroko keeps no running total of bytes allocated, only the current
+ * heap size, so that is what is reported.
+ *
+ * Lists, dicts, and instances of classes defined in Kuroko are all
+ * instances to the collector. @c demo_gcInstanceCounts breaks those
+ * down by class.
+ *
+ * The same figures are available to scripts as a dict from a
+ * @c gcstats() function; see @c demo_gcStatsBind
+ */
+#pragma once
+
+#include <stdio.h>
+#include <stddef.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/object.h>
+
+enum DemoGcType {
+	DEMO_GC_CODEOBJECT,
+	DEMO_GC_NATIVE,
+	DEMO_GC_CLOSURE,
+	DEMO_GC_STRING,
+	DEMO_GC_UPVALUE,
+	DEMO_GC_CLASS,
+	DEMO_GC_INSTANCE,
+	DEMO_GC_BOUND_METHOD,
+	DEMO_GC_TUPLE,
+	DEMO_GC_BYTES,
+	DEMO_GC_OTHER,
+	DEMO_GC_TYPE_COUNT
+};
+
+/**
+ * @brief Names for each @c DemoGcType, as used in @c gcstats()
+ */
+extern const char * demo_gcTypeNames[DEMO_GC_TYPE_COUNT];
+
+/**
+ * @brief Snapshot filled in by @c demo_gcStats
+ */
+struct DemoGcStats {
+	size_t heapSize;         /**< Current heap size, in bytes. */
+	size_t nextCollection;   /**< Heap size at which the VM will collect. */
+	size_t collections;      /**< Collections of any kind since @c demo_gcStatsInit */
+	size_t timedCollections; /**< Number of @c demo_collect calls. */
+	size_t liveAfterLast;    /**< Heap size after the last @c demo_collect */
+	size_t freedTotal;       /**< Bytes freed by all @c demo_collect calls. */
+	double pauseTotal;       /**< Total time in @c demo_collect, in seconds. */
+	double pauseMax;         /**< Longest single @c demo_collect, in seconds. */
+	size_t objects[DEMO_GC_TYPE_COUNT]; /**< Live objects by type. */
+};
+
+/**
+ * @brief Start counting collections.
+ *
+ * Must be called after @c krk_initVM; later calls have no effect.
+ * @c demo_collect and @c demo_gcStatsBind call it too.
+ */
+extern void demo_gcStatsInit(void);
+
+/**
+ * @brief Run a full collection, recording its pause time.
+ *
+ * @return Bytes freed, as from @c krk_collectGarbage
+ */
+extern size_t demo_collect(void);
+
+/**
+ * @brief Fill in @p stats
+ *
+ * Counting objects walks the whole heap, so this is meant for periodic
+ * monitoring rather than hot paths. Must not be called while another
+ * thread may be allocating.
+ */
+extern void demo_gcStats(struct DemoGcStats * stats);
+
+/**
+ * @brief Live instances of one class, as from @c demo_gcInstanceCounts
+ */
+struct DemoGcClassCount {
+	KrkClass * cls;  /**< Valid until the next collection. */
+	size_t count;    /**< Live instances whose class is exactly @c cls */
+};
+
+/**
+ * @brief Count live instances by class.
+ *
+ * Writes up to @p max entries to @p out, most common first, and returns
+ * the number of distinct classes, which may be larger. Walks the whole
+ * heap, with the same restrictions as @c demo_gcStats
+ */
+extern size_t demo_gcInstanceCounts(struct DemoGcClassCount * out, size_t max);
+
+/**
+ * @brief Bind @c gcstats() into @p module
+ *
+ * In the @c objects dict it returns, instances are counted under the
+ * name of their class, such as @c list or @c dict, rather than under
+ * @c instance. Pass @c vm.system to make it available as
+ * @c kuroko.gcstats()
+ */
+extern void demo_gcStatsBind(KrkInstance * module);
@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+"""
+Generate Kuroko wrappers for C functions.
+
+Reads a header, finds prototypes marked with DEMO_BIND, and writes a C
+source file with a KRK_Function wrapper for each of them plus a
+demo_bindGenerated() function that binds them all to a module.
+
+Usage: genbind.py bindings.h > bindings_gen.c
+"""
+import re
+import sys
+
+# C type -> (krk_parseArgs format, type check or None, unbox expression)
+PARAM_TYPES = {
+    'int':        ('i', 'IS_INTEGER({v}) && AS_INTEGER({v}) >= INT_MIN && AS_INTEGER({v}) <= INT_MAX',
+                   '(int)AS_INTEGER({v})'),
+    'double':     ('d', 'IS_FLOATING({v}) || IS_INTEGER({v})',
+                   '(IS_FLOATING({v}) ? AS_FLOATING({v}) : (double)AS_INTEGER({v}))'),
+    'size_t':     ('N', 'IS_INTEGER({v}) && AS_INTEGER({v}) >= 0',
+                   '(size_t)AS_INTEGER({v})'),
+    'const char*':('s', 'IS_STRING({v})',
+                   'AS_CSTRING({v})'),
+    'KrkValue':   ('V', None,
+                   '{v}'),
+}
+
+# C type -> expression boxing 'result'
+RETURN_TYPES = {
+    'void':       None,
+    'int':        'INTEGER_VAL(result)',
+    'double':     'FLOATING_VAL(result)',
+    'size_t':     'INTEGER_VAL(result)',
+    'const char*':'(result ? OBJECT_VAL(krk_copyString(result, strlen(result))) : NONE_VAL())',
+    'KrkValue':   'result',
+}
+
+PROTOTYPE = re.compile(r'^\s*DEMO_BIND\s+(.+?)\s*\(([^)]*)\)\s*;')
+
+def normalize(ctype):
+    ctype = re.sub(r'\s*\*\s*', '*', ctype.strip())
+    return re.sub(r'\s+', ' ', ctype)
+
+def split_decl(decl, what):
+    match = re.match(r'^(.*?[\s*])(\w+)$', decl.strip())
+    if not match:
+        raise SystemExit(f'genbind: cannot parse {what} "{decl.strip()}"')
+    return normalize(match.group(1)), match.group(2)
+
+def parse(path):
+    functions = []
+    with open(path) as f:
+        for lineno, line in enumerate(f, 1):
+            match = PROTOTYPE.match(line)
+            if not match:
+                continue
+            ret, name = split_decl(match.group(1), 'return type')
+            if ret not in RETURN_TYPES:
+                raise SystemExit(f'{path}:{lineno}: unsupported return type "{ret}"')
+            params = []
+            for param in match.group(2).split(','):
+                if not param.strip() or param.strip() == 'void':
+                    continue
+                ctype, pname = split_decl(param, 'parameter')
+                if ctype not in PARAM_TYPES:
+                    raise SystemExit(f'{path}:{lineno}: unsupported parameter type "{ctype}"')
+                params.append((ctype, pname))
+            functions.append((ret, name, params))
+    return functions
+
+def wrapper(ret, name, params):
+    out = []
+    count = len(params)
+    fmt = ''.join(PARAM_TYPES[ctype][0] for ctype, _ in params)
+    names = ','.join(f'"{pname}"' for _, pname in params)
+
+    out.append(f'KRK_Function({name}) {{')
+    if not params:
+        out.append('\tif (argc || hasKw) {')
+        out.append(f'\t\treturn krk_runtimeError(vm.exceptions->argumentError, "{name}() takes no arguments");')
+        out.append('\t}')
+    else:
+        for ctype, pname in params:
+            out.append(f'\t{ctype.replace("*", " *")} {pname};')
+        out.append('')
+        out.append(f'\tif (!hasKw && argc == {count}')
+        for i, (ctype, _) in enumerate(params):
+            check = PARAM_TYPES[ctype][1]
+            if check:
+                out.append(f'\t\t&& ({check.format(v=f"argv[{i}]")})')
+        out[-1] += ') {'
+        for i, (ctype, pname) in enumerate(params):
+            out.append(f'\t\t{pname} = {PARAM_TYPES[ctype][2].format(v=f"argv[{i}]")};')
+        out.append('\t} else {')
+        out.append('\t\t/* Keywords, conversions, and errors take the general path. */')
+        outputs = ', '.join(f'&{pname}' for _, pname in params)
+        out.append(f'\t\tif (!krk_parseArgs("{fmt}", (const char*[]){{{names}}}, {outputs})) return NONE_VAL();')
+        out.append('\t}')
+    out.append('')
+    call = f'{name}({", ".join(pname for _, pname in params)})'
+    if RETURN_TYPES[ret] is None:
+        out.append(f'\t{call};')
+        out.append('\treturn NONE_VAL();')
+    else:
+        out.append(f'\t{ret.replace("*", " *")} result = {call};')
+        out.append(f'\treturn {RETURN_TYPES[ret]};')
+    out.append('}')
+    out.append('')
+    return out
+
+def main():
+    if len(sys.argv) != 2:
+        raise SystemExit('usage: genbind.py HEADER > OUTPUT.c')
+    header = sys.argv[1]
+    functions = parse(header)
+
+    out = [
+        f'/* Generated by genbind.py from {header} - do not edit. */',
+        '#include <limits.h>',
+        '#include <string.h>',
+        '#include <kuroko/kuroko.h>',
+        '#include <kuroko/vm.h>',
+        '#include <kuroko/util.h>',
+        '',
+        f'#include "{header}"',
+        '',
+    ]
+    for ret, name, params in functions:
+        out.extend(wrapper(ret, name, params))
+
+    out.append('void demo_bindGenerated(KrkInstance * module) {')
+    for _, name, _ in functions:
+        out.append(f'\tBIND_FUNC(module,{name});')
+    out.append('}')
+    print('\n'.join(out))
+
+if __name__ == '__main__':
+    main()
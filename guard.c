@@ -0,0 +1,286 @@
+/**
+ * @file guard.c
+ * @brief Resource limits for untrusted snippets.
+ *
+ * Each guarded call keeps its state in a @c GuardCall on the caller's
+ * stack, linked into a list that one long-lived watchdog thread walks.
+ * The watchdog never touches a thread state: when a call goes over a
+ * limit it marks the call and sends @c DEMO_GUARD_SIGNAL to the thread
+ * that made it, and the handler, running on that thread, sets
+ * @c KRK_THREAD_SIGNALLED the same way the repl's Ctrl-C handler does.
+ * Turning the resulting @c KeyboardInterrupt into the right exception
+ * happens after the call, on the thread that made it.
+ */
+#include <time.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/vm.h>
+#include <kuroko/util.h>
+
+#include "guard.h"
+#include "roots.h"
+
+#define WATCHDOG_INTERVAL_USEC 1000
+
+enum Tripped {
+	TRIPPED_NONE,
+	TRIPPED_MEMORY,
+	TRIPPED_DEADLINE,
+};
+
+struct GuardCall {
+	struct DemoGuard * guard;
+	pthread_t thread;
+	struct GuardCall * next;   /**< Next in the list of active calls. */
+	struct GuardCall * outer;  /**< Call this one is nested in, on the same thread. */
+	size_t last;               /**< Heap size at the last sample. */
+	size_t allocated;          /**< Heap increases seen since the call started. */
+	double deadline;
+	int tripped;               /**< Read by the signal handler. */
+};
+
+static struct {
+	pthread_once_t once;
+	pthread_mutex_t lock;      /**< Guards everything below, and the counters in each DemoGuard. */
+	pthread_cond_t wake;
+	struct GuardCall * active;
+	size_t cleanUsers;         /**< Active calls that need KRK_GLOBAL_CLEAN_OUTPUT */
+	int cleanOutput;           /**< Whether it was set before the first of them. */
+} guards = { .once = PTHREAD_ONCE_INIT, .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* Innermost guarded call on this thread; read by the signal handler. */
+static __thread struct GuardCall * currentCall = NULL;
+
+static KrkClass * memoryError = NULL;
+static KrkClass * timeoutError = NULL;
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void interrupt(int sig) {
+	(void)sig;
+	struct GuardCall * call = __atomic_load_n(&currentCall, __ATOMIC_ACQUIRE);
+	for (; call; call = call->outer) {
+		if (__atomic_load_n(&call->tripped, __ATOMIC_ACQUIRE) != TRIPPED_NONE) {
+			krk_currentThread.flags |= KRK_THREAD_SIGNALLED;
+			return;
+		}
+	}
+}
+
+/* Called with the lock held. */
+static void sample(struct GuardCall * call, size_t heap) {
+	/*
+	 * Count every increase in the heap since the last sample, so garbage
+	 * counts too: a collection lowers the heap, and what is allocated
+	 * after it is counted again from there.
+	 */
+	if (heap > call->last) call->allocated += heap - call->last;
+	call->last = heap;
+}
+
+/* Called with the lock held; returns non-zero if the call is over a limit. */
+static int check(struct GuardCall * call, double t) {
+	if (call->tripped == TRIPPED_NONE) {
+		if (call->guard->maxBytes && call->allocated > call->guard->maxBytes) {
+			__atomic_store_n(&call->tripped, TRIPPED_MEMORY, __ATOMIC_RELEASE);
+		} else if (call->deadline && t > call->deadline) {
+			__atomic_store_n(&call->tripped, TRIPPED_DEADLINE, __ATOMIC_RELEASE);
+		}
+	}
+	return call->tripped != TRIPPED_NONE;
+}
+
+/*
+ * The heap is at its largest just before a sweep, so sample byte-limited
+ * calls whenever the collector marks; garbage made between two watchdog
+ * ticks is then still counted if a collection frees it.
+ */
+static void sampleOnCollect(void) {
+	pthread_mutex_lock(&guards.lock);
+	size_t heap = vm.bytesAllocated;
+	for (struct GuardCall * call = guards.active; call; call = call->next) {
+		if (!call->guard->maxBytes) continue;
+		sample(call, heap);
+		if (check(call, 0)) pthread_kill(call->thread, DEMO_GUARD_SIGNAL);
+	}
+	pthread_mutex_unlock(&guards.lock);
+}
+
+static void * watch(void * arg) {
+	(void)arg;
+	pthread_mutex_lock(&guards.lock);
+	for (;;) {
+		double t = now();
+		double wakeAt = 0;
+		int polling = 0;
+		size_t heap = __atomic_load_n(&vm.bytesAllocated, __ATOMIC_RELAXED);
+
+		for (struct GuardCall * call = guards.active; call; call = call->next) {
+			if (call->guard->maxBytes) {
+				sample(call, heap);
+				polling = 1;
+			}
+			if (check(call, t)) {
+				/* Keep signalling in case the script catches the interrupt. */
+				pthread_kill(call->thread, DEMO_GUARD_SIGNAL);
+				polling = 1;
+			} else if (call->deadline && (!wakeAt || call->deadline < wakeAt)) {
+				wakeAt = call->deadline;
+			}
+		}
+
+		/* Heap growth can only be seen by looking; deadlines can be waited for. */
+		if (polling && (!wakeAt || wakeAt > t + WATCHDOG_INTERVAL_USEC / 1e6)) {
+			wakeAt = t + WATCHDOG_INTERVAL_USEC / 1e6;
+		}
+
+		if (!wakeAt) {
+			pthread_cond_wait(&guards.wake, &guards.lock);
+		} else {
+			struct timespec until;
+			until.tv_sec = (time_t)wakeAt;
+			until.tv_nsec = (long)((wakeAt - until.tv_sec) * 1e9);
+			pthread_cond_timedwait(&guards.wake, &guards.lock, &until);
+		}
+	}
+	return NULL;
+}
+
+static KrkClass * builtinException(KrkClass ** cache, const char * name) {
+	if (*cache) return *cache;
+
+	KrkValue existing;
+	if (krk_tableGet_fast(&vm.builtins->fields, krk_copyString(name, strlen(name)), &existing) && IS_CLASS(existing)) {
+		*cache = AS_CLASS(existing);
+	} else {
+		krk_makeClass(vm.builtins, cache, name, vm.exceptions->Exception);
+		krk_finalizeClass(*cache);
+	}
+	return *cache;
+}
+
+static void initGuards(void) {
+	/* Make sure the exception classes exist before anything can fail. */
+	builtinException(&memoryError, "MemoryError");
+	builtinException(&timeoutError, "TimeoutError");
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = interrupt;
+	/* No SA_RESTART: a snippet blocked in a system call should wake up. */
+	sa.sa_flags = 0;
+	sigemptyset(&sa.sa_mask);
+	sigaction(DEMO_GUARD_SIGNAL, &sa, NULL);
+
+	demo_addRootScanner(sampleOnCollect);
+
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&guards.wake, &attr);
+	pthread_condattr_destroy(&attr);
+
+	/* If this fails, limits are still checked when the collector marks
+	 * and when each call ends. */
+	pthread_t tid;
+	pthread_attr_t threadAttr;
+	pthread_attr_init(&threadAttr);
+	pthread_attr_setdetachstate(&threadAttr, PTHREAD_CREATE_DETACHED);
+	pthread_create(&tid, &threadAttr, watch, NULL);
+	pthread_attr_destroy(&threadAttr);
+}
+
+static void startCall(struct GuardCall * call, struct DemoGuard * guard) {
+	pthread_once(&guards.once, initGuards);
+
+	call->guard = guard;
+	call->thread = pthread_self();
+	call->outer = currentCall;
+	call->allocated = 0;
+	call->deadline = guard->timeout > 0 ? now() + guard->timeout : 0;
+	call->tripped = TRIPPED_NONE;
+
+	pthread_mutex_lock(&guards.lock);
+	call->last = vm.bytesAllocated;
+	call->next = guards.active;
+	guards.active = call;
+
+	/* Tracebacks are printed after the exception has been replaced. */
+	if (!guards.cleanUsers++) {
+		guards.cleanOutput = vm.globalFlags & KRK_GLOBAL_CLEAN_OUTPUT;
+		vm.globalFlags |= KRK_GLOBAL_CLEAN_OUTPUT;
+	}
+	pthread_cond_signal(&guards.wake);
+	pthread_mutex_unlock(&guards.lock);
+
+	__atomic_store_n(&currentCall, call, __ATOMIC_RELEASE);
+}
+
+static void stopCall(struct GuardCall * call) {
+	struct DemoGuard * guard = call->guard;
+
+	pthread_mutex_lock(&guards.lock);
+	for (struct GuardCall ** link = &guards.active; *link; link = &(*link)->next) {
+		if (*link == call) {
+			*link = call->next;
+			break;
+		}
+	}
+
+	/* One last look, in case the limit was passed since the last tick. */
+	sample(call, vm.bytesAllocated);
+	check(call, now());
+
+	guard->calls++;
+	guard->totalBytes += call->allocated;
+	if (call->allocated > guard->peakBytes) guard->peakBytes = call->allocated;
+	if (call->tripped == TRIPPED_MEMORY) guard->exceeded++;
+	if (call->tripped == TRIPPED_DEADLINE) guard->timedOut++;
+
+	int cleanOutput = guards.cleanOutput;
+	if (!--guards.cleanUsers && !cleanOutput) vm.globalFlags &= ~KRK_GLOBAL_CLEAN_OUTPUT;
+	pthread_mutex_unlock(&guards.lock);
+
+	__atomic_store_n(&currentCall, call->outer, __ATOMIC_RELEASE);
+
+	if (call->tripped != TRIPPED_NONE) {
+		/* The interrupt may not have been noticed if the call was finishing. */
+		krk_currentThread.flags &= ~KRK_THREAD_SIGNALLED;
+
+		/* Replace the KeyboardInterrupt with something the host can act on. */
+		krk_currentThread.flags &= ~KRK_THREAD_HAS_EXCEPTION;
+		krk_currentThread.currentException = NONE_VAL();
+
+		if (call->tripped == TRIPPED_MEMORY) {
+			krk_runtimeError(memoryError, "allocation limit of %zu bytes exceeded", guard->maxBytes);
+		} else {
+			krk_runtimeError(timeoutError, "time limit of %d ms exceeded", (int)(guard->timeout * 1000));
+		}
+	}
+
+	if (!cleanOutput && (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) krk_dumpTraceback();
+}
+
+KrkValue demo_interpretGuarded(const char * src, const char * fromFile, struct DemoGuard * guard) {
+	struct GuardCall call;
+	startCall(&call, guard);
+	KrkValue result = krk_interpret(src, fromFile);
+	stopCall(&call);
+	return call.tripped != TRIPPED_NONE ? NONE_VAL() : result;
+}
+
+KrkValue demo_callGuarded(KrkValue callable, int argc, const KrkValue argv[], struct DemoGuard * guard) {
+	struct GuardCall call;
+	startCall(&call, guard);
+	krk_push(callable);
+	for (int i = 0; i < argc; ++i) krk_push(argv[i]);
+	KrkValue result = krk_callStack(argc);
+	stopCall(&call);
+	return call.tripped != TRIPPED_NONE ? NONE_VAL() : result;
+}
@@ -0,0 +1,89 @@
+/**
+ * @file guard.h
+ * @brief Resource limits for untrusted snippets.
+ *
+ * @c demo_interpretGuarded runs a snippet like @c krk_interpret, and
+ * @c demo_callGuarded calls a function from C, while a watchdog keeps an
+ * eye on them. One watchdog thread, started by the first guarded call,
+ * serves every guarded call on every thread. It sleeps until the
+ * nearest deadline, and only wakes every millisecond while some call
+ * has a byte limit, to look at the heap. Once a call passes one of its
+ * guard's limits, the watchdog sends @c DEMO_GUARD_SIGNAL to the thread
+ * running it, whose handler interrupts the VM the same way a Ctrl-C in
+ * the repl does, by setting @c KRK_THREAD_SIGNALLED. The handler is
+ * installed without @c SA_RESTART, so the signal also cuts short sleeps
+ * and blocking system calls in the snippet, which fail with @c EINTR
+ * and let the VM see the interrupt.
+ *
+ * Inside the snippet the interrupt is a @c KeyboardInterrupt, not a
+ * @c MemoryError or @c TimeoutError, so scripts can not catch it as one.
+ * A script that catches it anyway is interrupted again every millisecond
+ * until it unwinds. When the call returns to the host, the exception is
+ * replaced with a @c MemoryError or @c TimeoutError describing the limit.
+ * The guarded thread may see @c EINTR from its own system calls while
+ * a call it made is over its limit, so native code that blocks should
+ * either retry or give up and return to the VM.
+ *
+ * Allocation is counted as the sum of the increases in the heap size
+ * between samples, taken on every watchdog tick and every time the
+ * collector marks, so garbage still adds up. Memory freed other than by
+ * a collection between two samples is not seen, and a snippet can
+ * overshoot the limit by what it allocates in one tick. libkuroko only
+ * keeps one heap size for the whole VM, so while other threads run
+ * Kuroko code at the same time, their allocations count against every
+ * byte-limited call in progress. Code stuck inside a single native call
+ * that retries on @c EINTR, or never blocks, is only interrupted once it
+ * returns to the VM.
+ *
+ * Guards can be kept per module or per tenant and reused, from any
+ * number of threads; the usage counters add up over every call made
+ * with the same guard, and are updated under a lock.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <signal.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/value.h>
+
+/**
+ * @brief Signal used to interrupt guarded calls.
+ *
+ * Its handler is replaced by the first guarded call, so hosts that use
+ * @c SIGURG for something else should define this to another signal.
+ */
+#ifndef DEMO_GUARD_SIGNAL
+#define DEMO_GUARD_SIGNAL SIGURG
+#endif
+
+/**
+ * @brief Limits and usage for guarded calls.
+ */
+struct DemoGuard {
+	size_t maxBytes;   /**< Bytes each call may allocate; 0 for no limit. */
+	double timeout;    /**< Seconds allowed per call; 0 for no limit. */
+	size_t peakBytes;  /**< Most bytes allocated by any one call. */
+	size_t totalBytes; /**< Bytes allocated, summed over all calls. */
+	size_t calls;      /**< Number of guarded calls made. */
+	size_t exceeded;   /**< Number of calls stopped for going over the byte limit. */
+	size_t timedOut;   /**< Number of calls stopped for running out of time. */
+};
+
+/**
+ * @brief Run @p src like @c krk_interpret under @p guard
+ *
+ * May be called from any thread with a Kuroko thread state, including
+ * from inside another guarded call; each call is held to its own limits.
+ * If the watchdog thread can not be started, the limits are only checked
+ * when the collector marks and once the call has finished.
+ */
+extern KrkValue demo_interpretGuarded(const char * src, const char * fromFile, struct DemoGuard * guard);
+
+/**
+ * @brief Call @p callable with @p argc arguments under @p guard
+ *
+ * Behaves like pushing the callable and its arguments and calling
+ * @c krk_callStack, with the same restrictions as
+ * @c demo_interpretGuarded
+ */
+extern KrkValue demo_callGuarded(KrkValue callable, int argc, const KrkValue argv[], struct DemoGuard * guard);
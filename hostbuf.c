@@ -0,0 +1,230 @@
+/**
+ * @file hostbuf.c
+ * @brief Zero-copy buffers over host memory.
+ *
+ * Slices point into their parent's memory and hold a reference to the
+ * buffer that owns it, which the garbage collector follows through
+ * @c _ongcscan; only the owning buffer ever calls the release callback.
+ */
+#include <stdint.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/vm.h>
+#include <kuroko/util.h>
+
+#include "hostbuf.h"
+
+KrkClass * demo_bufferClass = NULL;
+
+#define IS_HostBuffer(o) (krk_isInstanceOf(o, demo_bufferClass))
+#define AS_HostBuffer(o) ((struct DemoBuffer*)AS_OBJECT(o))
+#define CURRENT_CTYPE struct DemoBuffer *
+#define CURRENT_NAME  self
+
+static size_t formatSize(char format) {
+	switch (format) {
+		case 'b': case 'B': return 1;
+		case 'h': case 'H': return 2;
+		case 'i': case 'I': case 'f': return 4;
+		case 'q': case 'd': return 8;
+		default: return 0;
+	}
+}
+
+static KrkValue loadItem(struct DemoBuffer * self, size_t i) {
+	char * p = (char*)self->data + i * self->itemsize;
+	switch (self->format) {
+		case 'b': return INTEGER_VAL(*(int8_t*)p);
+		case 'B': return INTEGER_VAL(*(uint8_t*)p);
+		case 'h': return INTEGER_VAL(*(int16_t*)p);
+		case 'H': return INTEGER_VAL(*(uint16_t*)p);
+		case 'i': return INTEGER_VAL(*(int32_t*)p);
+		case 'I': return INTEGER_VAL(*(uint32_t*)p);
+		case 'q': return INTEGER_VAL(*(int64_t*)p);
+		case 'f': return FLOATING_VAL(*(float*)p);
+		case 'd': return FLOATING_VAL(*(double*)p);
+	}
+	return NONE_VAL();
+}
+
+static int storeItem(struct DemoBuffer * self, size_t i, KrkValue value) {
+	char * p = (char*)self->data + i * self->itemsize;
+
+	if (self->format == 'f' || self->format == 'd') {
+		double d;
+		if (IS_FLOATING(value)) {
+			d = AS_FLOATING(value);
+		} else if (IS_INTEGER(value)) {
+			d = (double)AS_INTEGER(value);
+		} else {
+			krk_runtimeError(vm.exceptions->typeError, "buffer item should be float, not '%T'", value);
+			return 0;
+		}
+		if (self->format == 'f') {
+			*(float*)p = d;
+		} else {
+			*(double*)p = d;
+		}
+		return 1;
+	}
+
+	if (!IS_INTEGER(value)) {
+		krk_runtimeError(vm.exceptions->typeError, "buffer item should be int, not '%T'", value);
+		return 0;
+	}
+	krk_integer_type v = AS_INTEGER(value);
+
+	switch (self->format) {
+		case 'b': if (v < INT8_MIN  || v > INT8_MAX)   goto _range; *(int8_t*)p   = v; break;
+		case 'B': if (v < 0         || v > UINT8_MAX)  goto _range; *(uint8_t*)p  = v; break;
+		case 'h': if (v < INT16_MIN || v > INT16_MAX)  goto _range; *(int16_t*)p  = v; break;
+		case 'H': if (v < 0         || v > UINT16_MAX) goto _range; *(uint16_t*)p = v; break;
+		case 'i': if (v < INT32_MIN || v > INT32_MAX)  goto _range; *(int32_t*)p  = v; break;
+		case 'I': if (v < 0         || v > UINT32_MAX) goto _range; *(uint32_t*)p = v; break;
+		case 'q': *(int64_t*)p = v; break;
+	}
+	return 1;
+
+_range:
+	krk_runtimeError(vm.exceptions->valueError, "value out of range for format '%c'", self->format);
+	return 0;
+}
+
+static struct DemoBuffer * newView(struct DemoBuffer * parent, size_t start, size_t count) {
+	struct DemoBuffer * view = (struct DemoBuffer*)krk_newInstance(demo_bufferClass);
+	view->data = (char*)parent->data + start * parent->itemsize;
+	view->count = count;
+	view->itemsize = parent->itemsize;
+	view->format = parent->format;
+	view->readonly = parent->readonly;
+	view->release = NULL;
+	view->context = NULL;
+	view->owner = IS_NONE(parent->owner) ? OBJECT_VAL(parent) : parent->owner;
+	return view;
+}
+
+static int checkIndex(struct DemoBuffer * self, KrkValue index, size_t * out) {
+	if (!IS_INTEGER(index)) {
+		krk_runtimeError(vm.exceptions->typeError, "buffer index should be int, not '%T'", index);
+		return 0;
+	}
+	krk_integer_type i = AS_INTEGER(index);
+	if (i < 0) i += self->count;
+	if (i < 0 || (size_t)i >= self->count) {
+		krk_runtimeError(vm.exceptions->indexError, "buffer index out of range: %d", (int)AS_INTEGER(index));
+		return 0;
+	}
+	*out = i;
+	return 1;
+}
+
+KRK_Method(HostBuffer,__len__) {
+	return INTEGER_VAL(self->count);
+}
+
+KRK_Method(HostBuffer,__getitem__) {
+	if (argc != 2) return krk_runtimeError(vm.exceptions->argumentError, "__getitem__() takes exactly one argument");
+
+	if (IS_slice(argv[1])) {
+		krk_integer_type start, end, step;
+		if (krk_extractSlicer(_method_name, argv[1], self->count, &start, &end, &step)) return NONE_VAL();
+		if (step != 1) return krk_runtimeError(vm.exceptions->valueError, "buffer slices must be contiguous");
+		if (end < start) end = start;
+		return OBJECT_VAL(newView(self, start, end - start));
+	}
+
+	size_t i;
+	if (!checkIndex(self, argv[1], &i)) return NONE_VAL();
+	return loadItem(self, i);
+}
+
+KRK_Method(HostBuffer,__setitem__) {
+	if (argc != 3) return krk_runtimeError(vm.exceptions->argumentError, "__setitem__() takes exactly two arguments");
+	if (self->readonly) return krk_runtimeError(vm.exceptions->typeError, "buffer is read-only");
+
+	size_t i;
+	if (!checkIndex(self, argv[1], &i)) return NONE_VAL();
+	if (!storeItem(self, i, argv[2])) return NONE_VAL();
+	return argv[2];
+}
+
+KRK_Method(HostBuffer,tobytes) {
+	return OBJECT_VAL(krk_newBytes(self->count * self->itemsize, self->data));
+}
+
+KRK_Method(HostBuffer,__repr__) {
+	return krk_stringFromFormat("<HostBuffer format='%c' len=%zu%s>",
+		self->format, self->count, self->readonly ? " readonly" : "");
+}
+
+KRK_Method(HostBuffer,format) {
+	return OBJECT_VAL(krk_copyString(&self->format, 1));
+}
+
+KRK_Method(HostBuffer,itemsize) {
+	return INTEGER_VAL(self->itemsize);
+}
+
+KRK_Method(HostBuffer,nbytes) {
+	return INTEGER_VAL(self->count * self->itemsize);
+}
+
+KRK_Method(HostBuffer,readonly) {
+	return BOOLEAN_VAL(self->readonly);
+}
+
+static void _buffer_gcscan(KrkInstance * _self) {
+	krk_markValue(((struct DemoBuffer*)_self)->owner);
+}
+
+static void _buffer_gcsweep(KrkInstance * _self) {
+	struct DemoBuffer * self = (struct DemoBuffer*)_self;
+	if (self->release) self->release(self->data, self->context);
+	self->release = NULL;
+}
+
+void demo_bufferInit(KrkInstance * module) {
+	if (demo_bufferClass) {
+		krk_attachNamedObject(&module->fields, "HostBuffer", (KrkObj*)demo_bufferClass);
+		return;
+	}
+
+	KrkClass * HostBuffer = krk_makeClass(module, &demo_bufferClass, "HostBuffer", vm.baseClasses->objectClass);
+	HostBuffer->allocSize = sizeof(struct DemoBuffer);
+	HostBuffer->_ongcscan = _buffer_gcscan;
+	HostBuffer->_ongcsweep = _buffer_gcsweep;
+	BIND_METHOD(HostBuffer,__len__);
+	BIND_METHOD(HostBuffer,__getitem__);
+	BIND_METHOD(HostBuffer,__setitem__);
+	BIND_METHOD(HostBuffer,__repr__);
+	BIND_METHOD(HostBuffer,tobytes);
+	BIND_PROP(HostBuffer,format);
+	BIND_PROP(HostBuffer,itemsize);
+	BIND_PROP(HostBuffer,nbytes);
+	BIND_PROP(HostBuffer,readonly);
+	krk_finalizeClass(HostBuffer);
+}
+
+KrkValue demo_newBuffer(void * data, size_t count, char format, int readonly,
+		DemoBufferRelease release, void * context) {
+	size_t itemsize = formatSize(format);
+	if (!itemsize) return krk_runtimeError(vm.exceptions->valueError, "unsupported buffer format '%c'", format);
+
+	struct DemoBuffer * self = (struct DemoBuffer*)krk_newInstance(demo_bufferClass);
+	self->data = data;
+	self->count = count;
+	self->itemsize = itemsize;
+	self->format = format;
+	self->readonly = readonly;
+	self->release = release;
+	self->context = context;
+	self->owner = NONE_VAL();
+	return OBJECT_VAL(self);
+}
+
+int demo_bufferFromValue(KrkValue value, void ** data, size_t * nbytes) {
+	if (!demo_bufferClass || !IS_HostBuffer(value)) return 0;
+	struct DemoBuffer * self = AS_HostBuffer(value);
+	*data = self->data;
+	*nbytes = self->count * self->itemsize;
+	return 1;
+}
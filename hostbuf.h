@@ -0,0 +1,69 @@
+/**
+ * @file hostbuf.h
+ * @brief Zero-copy buffers over host memory.
+ *
+ * Handing a large array to Kuroko as a @c bytes or @c list object copies
+ * every element. A @c HostBuffer instead wraps memory owned by the host:
+ * scripts can take its length, index it, and slice it, and slices are
+ * views of the same memory rather than copies. When the last reference
+ * to a buffer (and all of its slices) is gone, an optional release
+ * callback hands the memory back to the host.
+ *
+ * Buffers are one-dimensional arrays of a single element type, named
+ * with the same characters as Python's struct module: @c b, @c B, @c h,
+ * @c H, @c i, @c I, @c q, @c f, and @c d. Slices must have a step of 1.
+ *
+ * Native functions can accept buffers with the @c O! format of
+ * @c krk_parseArgs and @c demo_bufferClass, or through
+ * @c demo_bufferFromValue
+ */
+#pragma once
+
+#include <stddef.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/value.h>
+#include <kuroko/object.h>
+
+typedef void (*DemoBufferRelease)(void * data, void * context);
+
+/**
+ * @brief Instance layout of @c HostBuffer objects.
+ */
+struct DemoBuffer {
+	KrkInstance inst;
+	void * data;
+	size_t count;              /**< Number of elements. */
+	size_t itemsize;           /**< Size of one element in bytes. */
+	char format;               /**< Element type character. */
+	int readonly;
+	DemoBufferRelease release; /**< Called when the buffer is collected, or NULL */
+	void * context;            /**< Passed to @c release */
+	KrkValue owner;            /**< Buffer this one is a slice of, or None. */
+};
+
+extern KrkClass * demo_bufferClass;
+
+/**
+ * @brief Create the @c HostBuffer class in @p module
+ *
+ * Must be called before any buffers are created. Later calls attach
+ * the same class to another module.
+ */
+extern void demo_bufferInit(KrkInstance * module);
+
+/**
+ * @brief Wrap @p count elements of type @p format at @p data
+ *
+ * The memory must stay valid until @p release is called, or for the
+ * life of the VM if @p release is NULL. Returns None and raises
+ * @c ValueError if @p format is not supported.
+ */
+extern KrkValue demo_newBuffer(void * data, size_t count, char format, int readonly,
+	DemoBufferRelease release, void * context);
+
+/**
+ * @brief Obtain the memory behind a @c HostBuffer
+ *
+ * Returns 0 without raising if @p value is not a buffer.
+ */
+extern int demo_bufferFromValue(KrkValue value, void ** data, size_t * nbytes);
@@ -0,0 +1,20 @@
+/**
+ * @file names.c
+ * @brief Interned string constants for hot C paths.
+ */
+#include <kuroko/kuroko.h>
+#include <kuroko/vm.h>
+#include <kuroko/util.h>
+
+#include "names.h"
+#include "roots.h"
+
+KrkString * demo_names[DEMO_NAME_COUNT];
+
+void demo_initNames(void) {
+#define DEMO_NAME_INIT(id, str) \
+	demo_names[DEMO_NAME_ ## id] = S(str); \
+	demo_keepAlive(OBJECT_VAL(demo_names[DEMO_NAME_ ## id]));
+	DEMO_NAMES(DEMO_NAME_INIT)
+#undef DEMO_NAME_INIT
+}
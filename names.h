@@ -0,0 +1,47 @@
+/**
+ * @file names.h
+ * @brief Interned string constants for hot C paths.
+ *
+ * The @c S() macro from the util header creates or looks up a string
+ * object every time it is evaluated. Names listed in @c DEMO_NAMES
+ * below are instead interned once by @c demo_initNames and kept alive
+ * for the life of the VM; @c DEMO_NAME(id) is then just an array load.
+ * It never goes through the VM's string table, which every thread
+ * shares, so prefer it over @c S() on paths that run in many threads.
+ *
+ * @code
+ * krk_tableGet_fast(&module->fields, DEMO_NAME(a), &value);
+ * @endcode
+ *
+ * Add an entry to @c DEMO_NAMES for each name you need; the identifier
+ * is used in @c DEMO_NAME and the string is the actual name.
+ */
+#pragma once
+
+#include <kuroko/kuroko.h>
+#include <kuroko/object.h>
+
+#define DEMO_NAMES(X) \
+	X(a, "a") \
+	X(b, "b")
+
+enum DemoNameId {
+#define DEMO_NAME_ID(id, str) DEMO_NAME_ ## id,
+	DEMO_NAMES(DEMO_NAME_ID)
+#undef DEMO_NAME_ID
+	DEMO_NAME_COUNT
+};
+
+extern KrkString * demo_names[DEMO_NAME_COUNT];
+
+/**
+ * @brief Obtain the interned string for a name listed in @c DEMO_NAMES
+ */
+#define DEMO_NAME(id) (demo_names[DEMO_NAME_ ## id])
+
+/**
+ * @brief Intern every name in @c DEMO_NAMES
+ *
+ * Call once after @c krk_initVM, before using @c DEMO_NAME
+ */
+extern void demo_initNames(void);
@@ -0,0 +1,377 @@
+/**
+ * @file profiler.c
+ * @brief Low-overhead sampling profiler for Kuroko code.
+ *
+ * Ticks come from a POSIX timer on the sampled thread's CPU clock, with
+ * the signal directed at that thread, so the handler always interrupts
+ * the thread whose frames it reads. It must not allocate or take locks,
+ * and samples may be written out after the objects they name are gone,
+ * so it copies function names by value into fixed-size ring buffer
+ * slots. Everything else - grouping identical stacks and formatting
+ * them - happens in @c demo_profilerWriteFolded with the signal blocked.
+ *
+ * Frames below the innermost one are live and rooted, and are read
+ * directly. The innermost frame is not safe to trust: the VM bumps
+ * @c frameCount before it stores the new frame's closure, so a tick can
+ * find the closure of an earlier call there, which may have been freed.
+ * Its pointers are only followed through copies made with
+ * @c process_vm_readv, which reports unmapped memory instead of faulting,
+ * and the frame is left out of the sample unless every object along the
+ * way has the expected type. A tick in that window can still attribute
+ * itself to the earlier call if that closure is alive.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/vm.h>
+#include <kuroko/util.h>
+
+#include "profiler.h"
+
+#define PROFILE_DEPTH 32
+#define PROFILE_NAME DEMO_PROFILER_NAME
+#define PROFILE_FILE DEMO_PROFILER_FILE
+
+struct ProfileSample {
+	unsigned char depth;
+	char names[PROFILE_DEPTH][PROFILE_NAME];
+	const void * leafCode;     /**< Code object of the innermost frame, as a key only. */
+	char leafFile[PROFILE_FILE];
+};
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+static struct {
+	int running;
+	KrkThreadState * thread;
+	pid_t pid;
+	pid_t tid;               /**< Kernel id of the sampled thread. */
+	timer_t timer;
+	struct ProfileSample * samples;
+	size_t capacity;
+	volatile size_t head;
+	volatile size_t idle;
+	struct sigaction previous;
+} profiler = {0};
+
+static void copyString(char * dest, size_t size, KrkString * string) {
+	size_t length = 0;
+	if (string) {
+		length = string->length < size - 1 ? string->length : size - 1;
+		memcpy(dest, string->chars, length);
+	}
+	dest[length] = '\0';
+}
+
+static void copyName(char * dest, KrkCodeObject * code) {
+	copyString(dest, PROFILE_NAME, code->qualname ? code->qualname : code->name);
+}
+
+static int safeRead(void * dest, const void * src, size_t length) {
+	struct iovec local = { dest, length };
+	struct iovec remote = { (void*)src, length };
+	return process_vm_readv(profiler.pid, &local, 1, &remote, 1, 0) == (ssize_t)length;
+}
+
+static int safeCopyString(char * dest, size_t size, KrkString * from) {
+	KrkString string;
+	if (!from) {
+		dest[0] = '\0';
+		return 1;
+	}
+	if (!safeRead(&string, from, sizeof(string)) || string.obj.type != KRK_OBJ_STRING) return 0;
+	size_t length = string.length < size - 1 ? string.length : size - 1;
+	if (!safeRead(dest, string.chars, length)) return 0;
+	dest[length] = '\0';
+	return 1;
+}
+
+/* Copy the innermost frame's details without trusting any of its pointers. */
+static int readLeaf(KrkCallFrame * frame, char * dest, struct ProfileSample * sample) {
+	KrkClosure closure;
+	KrkCodeObject code;
+
+	if (!safeRead(&closure, frame->closure, sizeof(closure)) || closure.obj.type != KRK_OBJ_CLOSURE) return 0;
+	if (!safeRead(&code, closure.function, sizeof(code)) || code.obj.type != KRK_OBJ_CODEOBJECT) return 0;
+
+	KrkString * name = code.qualname ? code.qualname : code.name;
+	if (!name || !safeCopyString(dest, PROFILE_NAME, name)) return 0;
+	if (!safeCopyString(sample->leafFile, PROFILE_FILE, code.chunk.filename)) return 0;
+	sample->leafCode = closure.function;
+	return 1;
+}
+
+static void takeSample(void) {
+	KrkThreadState * thread = profiler.thread;
+	size_t frameCount = thread->frameCount;
+	struct ProfileSample * sample = &profiler.samples[profiler.head % profiler.capacity];
+
+	char leaf[PROFILE_NAME];
+	size_t usable = frameCount;
+	if (frameCount && !readLeaf(&thread->frames[frameCount - 1], leaf, sample)) usable--;
+
+	if (!usable) {
+		profiler.idle++;
+		return;
+	}
+
+	if (usable < frameCount) {
+		KrkCodeObject * code = thread->frames[usable - 1].closure->function;
+		sample->leafCode = code;
+		copyString(sample->leafFile, PROFILE_FILE, code->chunk.filename);
+	}
+
+	/* Keep the innermost frames if the stack is deeper than a slot. */
+	size_t depth = usable < PROFILE_DEPTH ? usable : PROFILE_DEPTH;
+	size_t first = usable - depth;
+
+	for (size_t i = 0; i < depth; ++i) {
+		if (first + i == frameCount - 1) {
+			memcpy(sample->names[i], leaf, PROFILE_NAME);
+		} else {
+			copyName(sample->names[i], thread->frames[first + i].closure->function);
+		}
+	}
+	sample->depth = depth;
+	profiler.head++;
+}
+
+static void onSample(int sig) {
+	(void)sig;
+	/* Only our timer targets a thread, but SIGPROF may come from elsewhere. */
+	if (syscall(SYS_gettid) != profiler.tid) return;
+
+	int savedErrno = errno;
+	takeSample();
+	errno = savedErrno;
+}
+
+static int setTimer(unsigned int hz) {
+	struct itimerspec spec = {0};
+	if (hz) {
+		spec.it_interval.tv_sec = hz == 1 ? 1 : 0;
+		spec.it_interval.tv_nsec = hz == 1 ? 0 : 1000000000L / hz;
+		spec.it_value = spec.it_interval;
+	}
+	return timer_settime(profiler.timer, 0, &spec, NULL) == 0;
+}
+
+int demo_profilerStart(unsigned int hz, size_t capacity) {
+	if (profiler.running) return 0;
+	if (!hz) hz = 99;
+	if (hz > 1000000) hz = 1000000;
+	if (!capacity) capacity = 8192;
+
+	if (profiler.capacity != capacity) {
+		free(profiler.samples);
+		profiler.samples = calloc(capacity, sizeof(struct ProfileSample));
+		if (!profiler.samples) {
+			profiler.capacity = 0;
+			return 0;
+		}
+		profiler.capacity = capacity;
+		profiler.head = 0;
+	}
+
+	/* The handler must not go through thread-local storage, so capture
+	 * this thread's state here. */
+	profiler.thread = &krk_currentThread;
+	profiler.pid = getpid();
+	profiler.tid = syscall(SYS_gettid);
+
+	/* Count this thread's CPU time, and deliver the ticks to it alone. */
+	clockid_t clock;
+	if (pthread_getcpuclockid(pthread_self(), &clock)) return 0;
+	struct sigevent event = {0};
+	event.sigev_notify = SIGEV_THREAD_ID;
+	event.sigev_signo = SIGPROF;
+	event.sigev_notify_thread_id = profiler.tid;
+	if (timer_create(clock, &event, &profiler.timer)) return 0;
+
+	struct sigaction action = {0};
+	action.sa_handler = onSample;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	if (sigaction(SIGPROF, &action, &profiler.previous)) {
+		timer_delete(profiler.timer);
+		return 0;
+	}
+
+	if (!setTimer(hz)) {
+		sigaction(SIGPROF, &profiler.previous, NULL);
+		timer_delete(profiler.timer);
+		return 0;
+	}
+	profiler.running = 1;
+	return 1;
+}
+
+void demo_profilerStop(void) {
+	if (!profiler.running) return;
+	timer_delete(profiler.timer);
+	sigaction(SIGPROF, &profiler.previous, NULL);
+	profiler.running = 0;
+}
+
+static void blockSamples(sigset_t * old) {
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGPROF);
+	sigprocmask(SIG_BLOCK, &set, old);
+}
+
+void demo_profilerReset(void) {
+	sigset_t old;
+	blockSamples(&old);
+	profiler.head = 0;
+	profiler.idle = 0;
+	sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+struct DemoProfilerStats demo_profilerStats(void) {
+	struct DemoProfilerStats out;
+	size_t head = profiler.head;
+	out.samples = head;
+	out.idle = profiler.idle;
+	out.dropped = head > profiler.capacity ? head - profiler.capacity : 0;
+	return out;
+}
+
+static int compareFunctionKeys(const void * a, const void * b) {
+	const struct DemoProfilerFunction * x = a, * y = b;
+	if (x->code != y->code) return x->code < y->code ? -1 : 1;
+	return strcmp(x->file, y->file);
+}
+
+static int compareFunctionSamples(const void * a, const void * b) {
+	const struct DemoProfilerFunction * x = a, * y = b;
+	return (x->samples < y->samples) - (x->samples > y->samples);
+}
+
+size_t demo_profilerFunctionCounts(struct DemoProfilerFunction * out, size_t max) {
+	sigset_t old;
+	blockSamples(&old);
+	size_t count = profiler.head < profiler.capacity ? profiler.head : profiler.capacity;
+	struct DemoProfilerFunction * all = malloc((count ? count : 1) * sizeof(struct DemoProfilerFunction));
+	for (size_t i = 0; all && i < count; ++i) {
+		struct ProfileSample * sample = &profiler.samples[i];
+		all[i].code = sample->leafCode;
+		memcpy(all[i].name, sample->names[sample->depth - 1], PROFILE_NAME);
+		memcpy(all[i].file, sample->leafFile, PROFILE_FILE);
+		all[i].samples = 1;
+	}
+	sigprocmask(SIG_SETMASK, &old, NULL);
+	if (!all) return 0;
+
+	/* Merge samples of the same function, then put the busiest first. */
+	qsort(all, count, sizeof(struct DemoProfilerFunction), compareFunctionKeys);
+	size_t distinct = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (distinct && !compareFunctionKeys(&all[distinct - 1], &all[i])) {
+			all[distinct - 1].samples++;
+		} else {
+			all[distinct++] = all[i];
+		}
+	}
+	qsort(all, distinct, sizeof(struct DemoProfilerFunction), compareFunctionSamples);
+
+	if (out && max) memcpy(out, all, (distinct < max ? distinct : max) * sizeof(struct DemoProfilerFunction));
+	free(all);
+	return distinct;
+}
+
+static int compareStacks(const void * a, const void * b) {
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+int demo_profilerWriteFolded(FILE * out) {
+	sigset_t old;
+	blockSamples(&old);
+
+	size_t count = profiler.head < profiler.capacity ? profiler.head : profiler.capacity;
+	char ** stacks = calloc(count ? count : 1, sizeof(char*));
+	int result = stacks != NULL;
+
+	/* Render each sample as "outer;inner;leaf", then sort to group them. */
+	for (size_t i = 0; result && i < count; ++i) {
+		struct ProfileSample * sample = &profiler.samples[i];
+		stacks[i] = malloc((size_t)sample->depth * PROFILE_NAME + 1);
+		if (!stacks[i]) {
+			result = 0;
+			break;
+		}
+		char * c = stacks[i];
+		for (size_t f = 0; f < sample->depth; ++f) {
+			if (f) *c++ = ';';
+			size_t length = strlen(sample->names[f]);
+			memcpy(c, sample->names[f], length);
+			c += length;
+		}
+		*c = '\0';
+	}
+
+	sigprocmask(SIG_SETMASK, &old, NULL);
+
+	if (result) {
+		qsort(stacks, count, sizeof(char*), compareStacks);
+		for (size_t i = 0; i < count;) {
+			size_t run = i + 1;
+			while (run < count && !strcmp(stacks[run], stacks[i])) run++;
+			if (fprintf(out, "%s %zu\n", stacks[i], run - i) < 0) result = 0;
+			i = run;
+		}
+	}
+
+	if (stacks) {
+		for (size_t i = 0; i < count; ++i) free(stacks[i]);
+		free(stacks);
+	}
+	return result;
+}
+
+KRK_Function(function_counts) {
+	size_t count = demo_profilerFunctionCounts(NULL, 0);
+	struct DemoProfilerFunction * functions = malloc((count ? count : 1) * sizeof(struct DemoProfilerFunction));
+	if (!functions) return krk_runtimeError(vm.exceptions->Exception, "out of memory");
+	/* More functions may have been sampled since; only read what fits. */
+	size_t found = demo_profilerFunctionCounts(functions, count);
+	if (found < count) count = found;
+
+	KrkValue list = krk_list_of(0, NULL, 0);
+	krk_push(list);
+	for (size_t i = 0; i < count; ++i) {
+		krk_push(OBJECT_VAL(krk_copyString(functions[i].name, strlen(functions[i].name))));
+		krk_push(OBJECT_VAL(krk_copyString(functions[i].file, strlen(functions[i].file))));
+		krk_push(INTEGER_VAL(functions[i].samples));
+		KrkValue entry = OBJECT_VAL(krk_tuple_of(3, &krk_currentThread.stackTop[-3], 0));
+		krk_currentThread.stackTop[-3] = entry;
+		krk_pop();
+		krk_pop();
+		krk_writeValueArray(AS_LIST(list), entry);
+		krk_pop();
+	}
+
+	free(functions);
+	return krk_pop();
+}
+
+KRK_Function(reset_counts) {
+	demo_profilerReset();
+	return NONE_VAL();
+}
+
+void demo_profilerBind(KrkInstance * module) {
+	BIND_FUNC(module,function_counts);
+	BIND_FUNC(module,reset_counts);
+}
@@ -0,0 +1,111 @@
+/**
+ * @file profiler.h
+ * @brief Low-overhead sampling profiler for Kuroko code.
+ *
+ * Tracing every call with @c KRK_GLOBAL_CALLGRIND is thorough, but far
+ * too slow to leave enabled. This profiler instead uses a @c SIGPROF
+ * timer on the sampled thread's CPU clock: on each tick it copies the
+ * names of the functions on the Kuroko call stack into a preallocated
+ * ring buffer, and nothing else. At the default rate that costs well
+ * under a percent of run time.
+ *
+ * Samples can be written out at any time as folded stacks, one line per
+ * distinct stack followed by its sample count, which can be fed straight
+ * to flamegraph.pl, speedscope, and similar tools.
+ *
+ * Samples can also be counted by the function they landed in, which
+ * shows where the interpreter spends its time without
+ * @c KRK_THREAD_ENABLE_TRACING. There are no per-opcode counts: while
+ * an instruction runs, the frame's instruction pointer has already
+ * moved past it, and finding the instruction it belongs to would mean
+ * decoding the chunk with the VM's operand table.
+ *
+ * Only the thread that calls @c demo_profilerStart is sampled, and only
+ * that thread receives the ticks, so other threads using @c threading
+ * are never interrupted. The profiler still claims the process-wide
+ * @c SIGPROF handler while it runs, and ignores @c SIGPROF delivered to
+ * any other thread. Read samples back from the sampled thread, where
+ * they can be blocked while they are copied.
+ */
+#pragma once
+
+#include <stdio.h>
+#include <stddef.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/object.h>
+
+#define DEMO_PROFILER_NAME 32
+#define DEMO_PROFILER_FILE 64
+
+/**
+ * @brief Counters reported by @c demo_profilerStats
+ */
+struct DemoProfilerStats {
+	size_t samples;   /**< Ticks that landed in Kuroko code. */
+	size_t idle;      /**< Ticks that found no Kuroko frames. */
+	size_t dropped;   /**< Samples overwritten before they were written out. */
+};
+
+/**
+ * @brief Start sampling the current thread.
+ *
+ * @param hz       Samples per second of CPU time; 0 selects 99.
+ * @param capacity Number of samples the ring buffer holds; 0 selects 8192.
+ * @return 1 on success, 0 if the profiler is already running or the
+ *         timer could not be set up.
+ */
+extern int demo_profilerStart(unsigned int hz, size_t capacity);
+
+/**
+ * @brief Stop sampling. Recorded samples are kept until reset.
+ */
+extern void demo_profilerStop(void);
+
+/**
+ * @brief Discard recorded samples and zero the counters.
+ */
+extern void demo_profilerReset(void);
+
+/**
+ * @brief Write recorded samples to @p out as folded stacks.
+ *
+ * May be called while the profiler is running. Returns 0 on failure.
+ */
+extern int demo_profilerWriteFolded(FILE * out);
+
+/**
+ * @brief Obtain the current sample counters.
+ */
+extern struct DemoProfilerStats demo_profilerStats(void);
+
+/**
+ * @brief Samples attributed to one function by @c demo_profilerFunctionCounts
+ *
+ * Names and file names are cut to fit.
+ */
+struct DemoProfilerFunction {
+	const void * code;              /**< Identifies the code object; it may since have been freed. */
+	char name[DEMO_PROFILER_NAME];  /**< Qualified name. */
+	char file[DEMO_PROFILER_FILE];  /**< File the function was compiled from. */
+	size_t samples;                 /**< Samples in which it was the innermost frame. */
+};
+
+/**
+ * @brief Count samples by the function they landed in.
+ *
+ * Functions are told apart by code object and file name, so functions
+ * that share a name, such as @c <module> in every module, are counted
+ * separately. Writes up to @p max entries to @p out, most sampled first,
+ * and returns the number of distinct functions, which may be larger.
+ */
+extern size_t demo_profilerFunctionCounts(struct DemoProfilerFunction * out, size_t max);
+
+/**
+ * @brief Bind the profiler's counters into @p module
+ *
+ * Adds @c function_counts(), which returns a list of
+ * @c (name,file,count) tuples, most sampled first, and
+ * @c reset_counts(). Pass @c vm.system to make them available from
+ * the @c kuroko module.
+ */
+extern void demo_profilerBind(KrkInstance * module);
@@ -0,0 +1,79 @@
+/**
+ * @file roots.c
+ * @brief Keep host-held objects alive across garbage collection.
+ *
+ * Module objects have no @c _ongcscan hook of their own. The first call
+ * here installs one on the module class, and it marks the host roots
+ * whenever the collector scans @c vm.system - which it does on every
+ * collection, whatever scripts do to the module table. Scans of other
+ * modules are passed on to any hook that was there before.
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/vm.h>
+#include <kuroko/util.h>
+
+#include "roots.h"
+
+static struct {
+	pthread_mutex_t lock;        /**< Guards the arrays; also taken while marking. */
+	pthread_mutex_t hookLock;    /**< Serializes installing the hook. */
+	int installed;
+	KrkCleanupCallback previous; /**< The module class's hook before ours. */
+	KrkValue * values;
+	size_t count, capacity;
+	DemoRootScanner * scanners;
+	size_t scannerCount, scannerCapacity;
+} roots = { .lock = PTHREAD_MUTEX_INITIALIZER, .hookLock = PTHREAD_MUTEX_INITIALIZER };
+
+static void _module_gcscan(KrkInstance * module) {
+	if (roots.previous) roots.previous(module);
+	if (module != vm.system) return;
+
+	pthread_mutex_lock(&roots.lock);
+	for (size_t i = 0; i < roots.count; ++i) krk_markValue(roots.values[i]);
+	for (size_t i = 0; i < roots.scannerCount; ++i) roots.scanners[i]();
+	pthread_mutex_unlock(&roots.lock);
+}
+
+static void ensureHook(void) {
+	if (__atomic_load_n(&roots.installed, __ATOMIC_ACQUIRE)) return;
+	pthread_mutex_lock(&roots.hookLock);
+	if (!roots.installed) {
+		KrkClass * moduleClass = vm.baseClasses->moduleClass;
+		roots.previous = moduleClass->_ongcscan;
+		moduleClass->_ongcscan = _module_gcscan;
+		__atomic_store_n(&roots.installed, 1, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&roots.hookLock);
+}
+
+void demo_keepAlive(KrkValue value) {
+	ensureHook();
+
+	pthread_mutex_lock(&roots.lock);
+	if (roots.count == roots.capacity) {
+		roots.capacity = roots.capacity < 8 ? 8 : roots.capacity * 2;
+		roots.values = realloc(roots.values, sizeof(KrkValue) * roots.capacity);
+	}
+	roots.values[roots.count++] = value;
+	pthread_mutex_unlock(&roots.lock);
+}
+
+void demo_addRootScanner(DemoRootScanner scanner) {
+	ensureHook();
+	pthread_mutex_lock(&roots.lock);
+	for (size_t i = 0; i < roots.scannerCount; ++i) {
+		if (roots.scanners[i] == scanner) {
+			pthread_mutex_unlock(&roots.lock);
+			return;
+		}
+	}
+	if (roots.scannerCount == roots.scannerCapacity) {
+		roots.scannerCapacity = roots.scannerCapacity < 4 ? 4 : roots.scannerCapacity * 2;
+		roots.scanners = realloc(roots.scanners, sizeof(DemoRootScanner) * roots.scannerCapacity);
+	}
+	roots.scanners[roots.scannerCount++] = scanner;
+	pthread_mutex_unlock(&roots.lock);
+}
@@ -0,0 +1,42 @@
+/**
+ * @file roots.h
+ * @brief Keep host-held objects alive across garbage collection.
+ *
+ * The garbage collector only knows about values it can reach from the
+ * VM: the stack, the module table, builtins, and so on. A host that
+ * stashes a @c KrkString* or other object pointer in a C static has to
+ * make sure the object stays reachable, or it may be freed out from
+ * under it.
+ *
+ * Host roots live in C memory and are marked from the collector's
+ * scan of the @c kuroko module, which it always reaches, so there is
+ * nothing a script could delete or rebind to let them go.
+ * @c demo_keepAlive adds single values for the life of the VM; modules
+ * that keep many values in their own tables register a scan function
+ * with @c demo_addRootScanner instead.
+ */
+#pragma once
+
+#include <kuroko/kuroko.h>
+#include <kuroko/value.h>
+
+/**
+ * @brief Called during marking; should @c krk_markValue everything
+ *        the caller's tables hold.
+ */
+typedef void (*DemoRootScanner)(void);
+
+/**
+ * @brief Keep @p value reachable until the VM is freed.
+ *
+ * Must be called after @c krk_initVM. There is no way to release it.
+ */
+extern void demo_keepAlive(KrkValue value);
+
+/**
+ * @brief Call @p scanner every time the collector marks host roots.
+ *
+ * Must be called after @c krk_initVM. Registering the same scanner
+ * twice has no effect.
+ */
+extern void demo_addRootScanner(DemoRootScanner scanner);
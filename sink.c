@@ -0,0 +1,110 @@
+/**
+ * @file sink.c
+ * @brief Streaming output through a bounded string builder.
+ */
+#include <stdio.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/vm.h>
+#include <kuroko/util.h>
+
+#include "sink.h"
+
+static void initSink(struct DemoSink * sink, FILE * file, int fd, size_t limit) {
+	sink->sb = (struct StringBuilder){0};
+	sink->limit = limit ? limit : 4096;
+	sink->file = file;
+	sink->fd = fd;
+	sink->error = 0;
+	demo_reserveStringBuilder(&sink->sb, sink->limit);
+}
+
+void demo_sinkInitFile(struct DemoSink * sink, FILE * file, size_t limit) {
+	initSink(sink, file, -1, limit);
+}
+
+void demo_sinkInitFd(struct DemoSink * sink, int fd, size_t limit) {
+	initSink(sink, NULL, fd, limit);
+}
+
+static int writeOut(struct DemoSink * sink, const char * data, size_t length) {
+	if (sink->error) return 0;
+
+	if (sink->file) {
+		/* fwrite does not always set errno; don't report a stale one. */
+		errno = 0;
+		if (fwrite(data, 1, length, sink->file) != length) {
+			sink->error = errno ? errno : EIO;
+			return 0;
+		}
+		return 1;
+	}
+
+	while (length) {
+		ssize_t written = write(sink->fd, data, length);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			sink->error = errno;
+			return 0;
+		}
+		if (written == 0) {
+			sink->error = EIO;
+			return 0;
+		}
+		data += written;
+		length -= written;
+	}
+	return 1;
+}
+
+int demo_sinkFlush(struct DemoSink * sink) {
+	int result = writeOut(sink, sink->sb.bytes, sink->sb.length);
+	sink->sb.length = 0;
+	if (result && sink->file) fflush(sink->file);
+	return result;
+}
+
+int demo_sinkWrite(struct DemoSink * sink, const char * data, size_t length) {
+	if (sink->sb.length + length <= sink->limit) {
+		krk_pushStringBuilderStr(&sink->sb, data, length);
+		return sink->sb.length < sink->limit || demo_sinkFlush(sink);
+	}
+
+	/* Doesn't fit: write what we have, then large writes go straight out. */
+	if (!demo_sinkFlush(sink)) return 0;
+	if (length >= sink->limit) return writeOut(sink, data, length);
+	krk_pushStringBuilderStr(&sink->sb, data, length);
+	return 1;
+}
+
+int demo_sinkFormat(struct DemoSink * sink, struct DemoFormatPlan * plan, ...) {
+	/* Make room first, so a long item does not pile up on buffered output. */
+	if (sink->sb.length && sink->sb.length + plan->sizeHint > sink->limit && !demo_sinkFlush(sink)) return 0;
+
+	va_list args;
+	va_start(args, plan);
+	int result = demo_pushFormatV(&sink->sb, plan, args);
+	va_end(args);
+
+	if (result && sink->sb.length >= sink->limit) result = demo_sinkFlush(sink);
+
+	/*
+	 * A conversion such as a long %R is formatted whole before it can be
+	 * written out. Once it has been, give back the extra space, so the
+	 * buffer does not stay at the size of the largest item.
+	 */
+	if (sink->sb.capacity > sink->limit * 2 && !sink->sb.length) {
+		krk_discardStringBuilder(&sink->sb);
+		sink->sb = (struct StringBuilder){0};
+		demo_reserveStringBuilder(&sink->sb, sink->limit);
+	}
+	return result && !sink->error;
+}
+
+int demo_sinkClose(struct DemoSink * sink) {
+	int result = demo_sinkFlush(sink);
+	krk_discardStringBuilder(&sink->sb);
+	return result;
+}
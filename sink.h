@@ -0,0 +1,78 @@
+/**
+ * @file sink.h
+ * @brief Streaming output through a bounded string builder.
+ *
+ * Building a large report in a @c StringBuilder keeps the whole thing
+ * in memory until it is written out. A @c DemoSink wraps a builder of
+ * a fixed size that is flushed to a @c FILE* or file descriptor
+ * whenever it fills up, so output streams in bounded memory.
+ *
+ * @code
+ * struct DemoSink sink;
+ * demo_sinkInitFile(&sink, stdout, 64 * 1024);
+ * for (...) {
+ *     if (!demo_sinkFormat(&sink, &plan, ...)) break;
+ * }
+ * demo_sinkClose(&sink);
+ * @endcode
+ */
+#pragma once
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/util.h>
+
+#include "fmtplan.h"
+
+/**
+ * @brief Builder that flushes to a file as it fills.
+ */
+struct DemoSink {
+	struct StringBuilder sb;
+	size_t limit;  /**< Flush once this many bytes are buffered. */
+	FILE * file;   /**< Destination stream, or NULL when writing to @c fd */
+	int fd;        /**< Destination file descriptor, if @c file is NULL */
+	int error;     /**< Set to errno if a write failed. */
+};
+
+/**
+ * @brief Prepare a sink that writes to @p file in chunks of @p limit bytes.
+ */
+extern void demo_sinkInitFile(struct DemoSink * sink, FILE * file, size_t limit);
+
+/**
+ * @brief Prepare a sink that writes to @p fd in chunks of @p limit bytes.
+ */
+extern void demo_sinkInitFd(struct DemoSink * sink, int fd, size_t limit);
+
+/**
+ * @brief Append raw bytes.
+ *
+ * Writes larger than the sink's limit bypass the buffer entirely.
+ * Returns 0 if a write to the destination failed.
+ */
+extern int demo_sinkWrite(struct DemoSink * sink, const char * data, size_t length);
+
+/**
+ * @brief Append formatted output using a precompiled plan.
+ *
+ * Output already buffered is written out first if the item might not
+ * fit. A single item longer than the limit is still formatted whole,
+ * then written out, and the buffer is shrunk back to the limit.
+ * Returns 0 if a conversion raised an exception or a write failed.
+ */
+extern int demo_sinkFormat(struct DemoSink * sink, struct DemoFormatPlan * plan, ...);
+
+/**
+ * @brief Write out everything buffered so far.
+ */
+extern int demo_sinkFlush(struct DemoSink * sink);
+
+/**
+ * @brief Flush the sink and release its buffer.
+ *
+ * Does not close the underlying file or descriptor.
+ */
+extern int demo_sinkClose(struct DemoSink * sink);
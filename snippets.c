@@ -0,0 +1,188 @@
+/**
+ * @file snippets.c
+ * @brief Compiled-snippet cache for krk_interpret.
+ *
+ * Entries live in a C hash table with open addressing. The table holds
+ * raw pointers to code objects, which a root scanner from @c roots.h
+ * marks on every collection, and to modules, which it does not: a
+ * @c _ongcsweep hook on the module class drops a module's entries when
+ * the module itself is freed, so the cache never keeps a module alive
+ * and a new module at the same address never finds stale code.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/vm.h>
+#include <kuroko/util.h>
+#include <kuroko/compiler.h>
+
+#include "roots.h"
+#include "snippets.h"
+
+#define SNIPPET_DEFAULT_MAX 1024
+
+struct SnippetEntry {
+	uint32_t hash;
+	char * source;
+	char * fromFile;
+	KrkInstance * module;
+	KrkCodeObject * code;
+};
+
+static struct {
+	int enabled;
+	KrkCleanupCallback previousSweep; /**< The module class's hook before ours. */
+	size_t maxEntries;
+	size_t capacity;
+	size_t count;
+	struct SnippetEntry * entries;
+	struct DemoSnippetStats stats;
+} cache = {0};
+
+static uint32_t hashSnippet(const char * src, const char * fromFile, KrkInstance * module) {
+	/* FNV-1a over both strings, then mix in the module pointer. */
+	uint32_t hash = 2166136261u;
+	for (const char * c = src; *c; ++c) hash = (hash ^ (uint8_t)*c) * 16777619u;
+	hash = (hash ^ 0xFF) * 16777619u;
+	for (const char * c = fromFile; *c; ++c) hash = (hash ^ (uint8_t)*c) * 16777619u;
+	uint64_t m = (uintptr_t)module;
+	hash ^= (uint32_t)(m ^ (m >> 32));
+	return hash;
+}
+
+static struct SnippetEntry * findSlot(struct SnippetEntry * entries, size_t capacity,
+		uint32_t hash, const char * src, const char * fromFile, KrkInstance * module) {
+	size_t index = hash & (capacity - 1);
+	for (;;) {
+		struct SnippetEntry * entry = &entries[index];
+		if (!entry->code) return entry;
+		if (entry->hash == hash && entry->module == module &&
+			!strcmp(entry->source, src) && !strcmp(entry->fromFile, fromFile)) return entry;
+		index = (index + 1) & (capacity - 1);
+	}
+}
+
+static void rehash(size_t newCapacity) {
+	struct SnippetEntry * newEntries = calloc(newCapacity, sizeof(struct SnippetEntry));
+	for (size_t i = 0; i < cache.capacity; ++i) {
+		struct SnippetEntry * old = &cache.entries[i];
+		if (!old->code) continue;
+		*findSlot(newEntries, newCapacity, old->hash, old->source, old->fromFile, old->module) = *old;
+	}
+	free(cache.entries);
+	cache.entries = newEntries;
+	cache.capacity = newCapacity;
+}
+
+static void growTable(void) {
+	rehash(cache.capacity ? cache.capacity * 2 : 16);
+}
+
+static void flushEntries(void) {
+	for (size_t i = 0; i < cache.capacity; ++i) {
+		free(cache.entries[i].source);
+		free(cache.entries[i].fromFile);
+	}
+	memset(cache.entries, 0, sizeof(struct SnippetEntry) * cache.capacity);
+	cache.count = 0;
+}
+
+static void scanEntries(void) {
+	for (size_t i = 0; i < cache.capacity; ++i) {
+		if (cache.entries[i].code) krk_markValue(OBJECT_VAL(cache.entries[i].code));
+	}
+}
+
+static void _module_gcsweep(KrkInstance * module) {
+	if (cache.previousSweep) cache.previousSweep(module);
+
+	size_t removed = 0;
+	for (size_t i = 0; i < cache.capacity; ++i) {
+		struct SnippetEntry * entry = &cache.entries[i];
+		if (!entry->code || entry->module != module) continue;
+		free(entry->source);
+		free(entry->fromFile);
+		memset(entry, 0, sizeof(struct SnippetEntry));
+		removed++;
+	}
+
+	/* Emptied slots would cut probe sequences short; reinsert the rest. */
+	if (removed) {
+		cache.count -= removed;
+		rehash(cache.capacity);
+	}
+}
+
+void demo_snippetCacheEnable(size_t maxEntries) {
+	cache.maxEntries = maxEntries ? maxEntries : SNIPPET_DEFAULT_MAX;
+	if (cache.enabled) return;
+
+	demo_addRootScanner(scanEntries);
+	KrkClass * moduleClass = vm.baseClasses->moduleClass;
+	cache.previousSweep = moduleClass->_ongcsweep;
+	moduleClass->_ongcsweep = _module_gcsweep;
+	cache.enabled = 1;
+}
+
+void demo_snippetCacheClear(void) {
+	if (cache.entries) flushEntries();
+	cache.stats.hits = 0;
+	cache.stats.misses = 0;
+}
+
+struct DemoSnippetStats demo_snippetCacheStats(void) {
+	struct DemoSnippetStats out = cache.stats;
+	out.entries = cache.count;
+	return out;
+}
+
+static KrkCodeObject * compileSnippet(const char * src, const char * fromFile) {
+	KrkCodeObject * code = krk_compile(src, fromFile);
+	if (!code && !krk_currentThread.frameCount && !(vm.globalFlags & KRK_GLOBAL_CLEAN_OUTPUT)) {
+		/* krk_interpret reports syntax errors at the top level itself. */
+		krk_dumpTraceback();
+	}
+	return code;
+}
+
+KrkValue demo_interpretCached(const char * src, const char * fromFile) {
+	if (!cache.enabled) return krk_interpret(src, fromFile);
+
+	KrkInstance * module = krk_currentThread.module;
+	uint32_t hash = hashSnippet(src, fromFile, module);
+	KrkCodeObject * code = NULL;
+
+	if (cache.count) {
+		struct SnippetEntry * entry = findSlot(cache.entries, cache.capacity, hash, src, fromFile, module);
+		code = entry->code;
+	}
+
+	if (code) {
+		cache.stats.hits++;
+	} else {
+		cache.stats.misses++;
+		code = compileSnippet(src, fromFile);
+		if (!code) return NONE_VAL();
+
+		if (cache.count >= cache.maxEntries) flushEntries();
+		if ((cache.count + 1) * 4 > cache.capacity * 3) growTable();
+
+		struct SnippetEntry * entry = findSlot(cache.entries, cache.capacity, hash, src, fromFile, module);
+		entry->hash = hash;
+		entry->source = strdup(src);
+		entry->fromFile = strdup(fromFile);
+		entry->module = module;
+		entry->code = code;
+		cache.count++;
+	}
+
+	/* From here on, this is what krk_interpret does with a fresh code object. */
+	krk_push(OBJECT_VAL(code));
+	krk_attachNamedObject(&module->fields, "__file__", (KrkObj*)code->chunk.filename);
+	KrkClosure * closure = krk_newClosure(code, OBJECT_VAL(module));
+	krk_pop();
+
+	krk_push(OBJECT_VAL(closure));
+	return krk_callStack(0);
+}
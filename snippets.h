@@ -0,0 +1,62 @@
+/**
+ * @file snippets.h
+ * @brief Compiled-snippet cache for krk_interpret.
+ *
+ * Hosts that feed the same short strings to @c krk_interpret over and
+ * over pay for the scanner and compiler every time. The functions here
+ * keep the resulting code objects around, keyed by the source text, the
+ * file name, and the module the code runs in, so repeated snippets only
+ * pay for building a closure and running it.
+ *
+ * The cache is opt-in: nothing is cached until @c demo_snippetCacheEnable
+ * has been called, and @c demo_interpretCached behaves exactly like
+ * @c krk_interpret while it is disabled.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <kuroko/kuroko.h>
+#include <kuroko/value.h>
+
+/**
+ * @brief Counters reported by @c demo_snippetCacheStats
+ */
+struct DemoSnippetStats {
+	size_t hits;    /**< Calls that reused an existing code object. */
+	size_t misses;  /**< Calls that had to compile their source. */
+	size_t entries; /**< Code objects currently held by the cache. */
+};
+
+/**
+ * @brief Enable the snippet cache.
+ *
+ * Must be called after @c krk_initVM. Compiled code objects are kept
+ * alive by the cache, so @p maxEntries bounds how much it can hold;
+ * when the limit is reached the whole cache is flushed and refilled.
+ * Pass 0 to use a default limit. Modules are not kept alive: when a
+ * module is collected, the entries compiled for it are dropped.
+ */
+extern void demo_snippetCacheEnable(size_t maxEntries);
+
+/**
+ * @brief Drop all cached code objects and reset the counters.
+ *
+ * Call this before @c krk_freeVM, or whenever cached snippets should
+ * be recompiled.
+ */
+extern void demo_snippetCacheClear(void);
+
+/**
+ * @brief Obtain the current hit/miss counters.
+ */
+extern struct DemoSnippetStats demo_snippetCacheStats(void);
+
+/**
+ * @brief Cached equivalent of @c krk_interpret
+ *
+ * Runs @p src at the top level of the current module, reusing the
+ * compiled code from an earlier call with the same source, file name,
+ * and module. Returns the same values and reports errors the same way
+ * as @c krk_interpret
+ */
+extern KrkValue demo_interpretCached(const char * src, const char * fromFile);